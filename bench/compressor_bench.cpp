@@ -0,0 +1,614 @@
+/**
+ * @file compressor_bench.cpp
+ * @brief Per-stage throughput benchmark for the Huffman compressor.
+ *
+ * Builds a reproducible corpus (Canterbury text, generated binary records,
+ * low-entropy, sparse, two-valued and random bytes) at several sizes and times each
+ * stage of the pipeline on its own and end to end, both in memory and
+ * through files. The in-memory end-to-end stages also run with the tANS
+ * coder (suffix _ans), with LZ77 at levels 1 and 6 (_lz1, _lz6) and with
+ * per-block checksums (_crc). The histogram, checksum, encode and decode
+ * kernels run once per instruction set level the processor supports, so the
+ * cpu column shows what each level gains. The file stages also archive and
+ * extract a small tree holding the corpus, an empty directory and symbolic
+ * links, which must be skipped.
+ * Every measurement is printed as one JSON object per line (or one CSV row)
+ * with throughput, compression ratio and heap allocations per iteration, so
+ * results can be diffed between releases. Every coded stage is also checked
+ * to decode back to its input; a mismatch is reported on stderr and makes
+ * the exit status 1.
+ */
+#include "archive.h"
+#include "compressor.h"
+#include "fileHandles.h"
+#include "huffman.h"
+#include "bitstream.h"
+#include "checksum.h"
+#include "codec.h"
+#include "cpuFeatures.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#ifndef BENCH_CORPUS_DIR
+#define BENCH_CORPUS_DIR "src"
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Every heap allocation in the process goes through here so stages can report their allocation counts
+static atomic<uint64_t> allocationCount{0};
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    if (void* ptr = malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+namespace {
+    // Command line settings
+    struct BenchConfig {
+        vector<size_t> sizes = {size_t(64) << 10, size_t(1) << 20, size_t(16) << 20}; // Corpus sizes
+        vector<unsigned> threads = {1, 2, 4};    // Thread counts for the file stages
+        double minTime = 0.2;                    // Seconds each measurement runs at least
+        string format = "json";                  // json or csv
+        string corpusDir = BENCH_CORPUS_DIR;     // Directory holding alice29.txt
+        bool fileStages = true;                  // Include compress/decompress through files
+        vector<CpuLevel> cpuLevels;              // Levels the kernel stages run at; empty means every supported level
+    };
+
+    // One line of output
+    struct Measurement {
+        string corpus;
+        size_t size = 0;
+        string stage;
+        unsigned threads = 1;
+        string cpu;                  // Instruction set level the kernels ran at
+        uint64_t iterations = 0;
+        double seconds = 0;          // Total time over all iterations
+        uint64_t allocations = 0;    // Total allocations over all iterations
+        double ratio = 0;            // Uncompressed / compressed size, 0 if not applicable
+    };
+
+    // Runs body until minTime has passed (at least once) and records time and allocations
+    Measurement measure(const BenchConfig& config, const function<void()>& body) {
+        Measurement result;
+        uint64_t allocationsBefore = allocationCount.load();
+        auto start = chrono::steady_clock::now();
+        do {
+            body();
+            ++result.iterations;
+            result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        } while (result.seconds < config.minTime);
+        result.allocations = allocationCount.load() - allocationsBefore;
+        return result;
+    }
+
+    void printHeader(const BenchConfig& config) {
+        if (config.format == "csv") {
+            cout << "corpus,size,stage,threads,cpu,iterations,mb_per_s,ratio,allocations_per_iteration\n";
+        }
+    }
+
+    void print(const BenchConfig& config, const Measurement& m) {
+        double mbPerSecond = m.seconds > 0 ? m.size * static_cast<double>(m.iterations) / m.seconds / 1e6 : 0;
+        double allocations = static_cast<double>(m.allocations) / m.iterations;
+        char line[512];
+        if (config.format == "csv") {
+            snprintf(line, sizeof(line), "%s,%zu,%s,%u,%s,%llu,%.1f,%.4f,%.1f\n", m.corpus.c_str(), m.size, m.stage.c_str(), m.threads,
+                     m.cpu.c_str(), static_cast<unsigned long long>(m.iterations), mbPerSecond, m.ratio, allocations);
+        } else {
+            snprintf(line, sizeof(line),
+                     "{\"corpus\":\"%s\",\"size\":%zu,\"stage\":\"%s\",\"threads\":%u,\"cpu\":\"%s\",\"iterations\":%llu,"
+                     "\"mb_per_s\":%.1f,\"ratio\":%.4f,\"allocations_per_iteration\":%.1f}\n",
+                     m.corpus.c_str(), m.size, m.stage.c_str(), m.threads, m.cpu.c_str(),
+                     static_cast<unsigned long long>(m.iterations), mbPerSecond, m.ratio, allocations);
+        }
+        cout << line << flush;
+    }
+
+    // Canterbury alice29.txt repeated to the requested size, or generated English-like text if it is missing
+    vector<unsigned char> makeText(const BenchConfig& config, size_t size) {
+        ifstream file(fs::path(config.corpusDir) / "alice29.txt", ios::binary);
+        vector<unsigned char> seed((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        if (seed.empty()) {
+            static const char* words[] = {"the", "of", "and", "to", "a", "in", "that", "is", "was", "she", "it", "said",
+                                          "alice", "queen", "rabbit", "little", "very", "down", "out", "what", "would"};
+            mt19937 random(29);
+            string text;
+            while (text.size() < (1u << 20)) {
+                size_t word = min<size_t>(random() % 8 * random() % 21, 20); // Skewed towards common words
+                text += words[word];
+                text += random() % 12 == 0 ? ".\n" : " ";
+            }
+            seed.assign(text.begin(), text.end());
+        }
+        vector<unsigned char> data(size);
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = seed[i % seed.size()];
+        }
+        return data;
+    }
+
+    // Fixed-layout records: counter, small measurement, flags and zero padding
+    vector<unsigned char> makeBinary(size_t size) {
+        mt19937 random(7);
+        vector<unsigned char> data(size);
+        uint32_t counter = 1000;
+        for (size_t i = 0; i + 16 <= size; i += 16) {
+            counter += 1 + random() % 3;
+            uint32_t measurement = 50000 + random() % 2000;
+            memcpy(&data[i], &counter, 4);
+            memcpy(&data[i + 4], &measurement, 4);
+            data[i + 8] = static_cast<unsigned char>(random() % 4);
+        }
+        return data;
+    }
+
+    // Geometrically distributed bytes (about 2 bits of entropy each) with occasional long runs
+    vector<unsigned char> makeLowEntropy(size_t size) {
+        mt19937 random(11);
+        geometric_distribution<int> geometric(0.5);
+        vector<unsigned char> data(size);
+        for (size_t i = 0; i < size;) {
+            if (random() % 64 == 0) {
+                size_t run = min<size_t>(256 + random() % 4096, size - i);
+                fill(data.begin() + i, data.begin() + i + run, 0);
+                i += run;
+            } else {
+                data[i++] = static_cast<unsigned char>(min(geometric(random), 255));
+            }
+        }
+        return data;
+    }
+
+    // Telemetry-like samples: mostly zero, sometimes one, rarely a small value; well under one bit per byte
+    vector<unsigned char> makeSparse(size_t size) {
+        mt19937 random(17);
+        vector<unsigned char> data(size);
+        for (unsigned char& byte : data) {
+            uint32_t draw = random() % 100;
+            byte = static_cast<unsigned char>(draw < 90 ? 0 : draw < 97 ? 1 : 2 + random() % 14);
+        }
+        return data;
+    }
+
+    // Two byte values, one about 45 times as common as the other, so the table holds 1-bit codes only
+    vector<unsigned char> makeTwoSymbol(size_t size) {
+        mt19937 random(19);
+        vector<unsigned char> data(size);
+        for (unsigned char& byte : data) {
+            byte = random() % 46 == 0 ? 'b' : 'a';
+        }
+        return data;
+    }
+
+    vector<unsigned char> makeRandom(size_t size) {
+        mt19937 random(13);
+        vector<unsigned char> data(size);
+        for (unsigned char& byte : data) {
+            byte = static_cast<unsigned char>(random());
+        }
+        return data;
+    }
+
+    bool roundTripFailed = false; // Set when some stage's output does not decode back to its input
+
+    // Reports a stage whose output did not decode back to the original bytes
+    void checkRoundTrip(const string& corpus, const string& stage, const string& decoded, const unsigned char* original, size_t size) {
+        if (decoded.size() != size || memcmp(decoded.data(), original, size) != 0) {
+            cerr << "Round trip failed: " << corpus << " " << stage << " at cpu level " << cpuLevelName(cpuLevel()) << endl;
+            roundTripFailed = true;
+        }
+    }
+
+    // Times every stage on one corpus file
+    void benchCorpus(const BenchConfig& config, const string& name, const vector<unsigned char>& data) {
+        const size_t blockSize = compressor::DEFAULT_BLOCK_SIZE;
+        const unsigned maxLength = compressor::DEFAULT_MAX_CODE_LENGTH;
+        size_t blockCount = (data.size() + blockSize - 1) / blockSize;
+        auto blockData = [&](size_t block) { return data.data() + block * blockSize; };
+        auto blockLength = [&](size_t block) { return min(blockSize, data.size() - block * blockSize); };
+        auto report = [&](const string& stage, Measurement m, double ratio = 0, unsigned threads = 1) {
+            m.corpus = name;
+            m.size = data.size();
+            m.stage = stage;
+            m.ratio = ratio;
+            m.threads = threads;
+            m.cpu = cpuLevelName(cpuLevel());
+            print(config, m);
+        };
+
+        // Inputs for the isolated stages, prepared outside the timed loops
+        vector<fileHandles::ByteHistogram> histograms(blockCount);
+        vector<HuffmanCodeTable> codes(blockCount);
+        for (size_t block = 0; block < blockCount; ++block) {
+            fileHandles::countBytes(blockData(block), blockLength(block), histograms[block]);
+            FlatHuffmanTree tree;
+            tree.build(histograms[block]);
+            tree.codeLengths(codes[block]);
+            unsigned longest = 0;
+            for (const HuffmanCodeEntry& entry : codes[block]) {
+                longest = max<unsigned>(longest, entry.length);
+            }
+            if (longest > maxLength) {
+                buildLengthLimitedCodeLengths(histograms[block], maxLength, codes[block]);
+            }
+            buildCanonicalCodes(codes[block]);
+        }
+
+        report("histogram_map", measure(config, [&]() {
+            map<char, unsigned> frequencies;
+            for (unsigned char byte : data) {
+                frequencies[static_cast<char>(byte)]++;
+            }
+        }));
+
+        for (CpuLevel level : config.cpuLevels) {
+            setCpuLevel(level);
+            report("histogram", measure(config, [&]() {
+                for (size_t block = 0; block < blockCount; ++block) {
+                    fileHandles::ByteHistogram histogram{};
+                    fileHandles::countBytes(blockData(block), blockLength(block), histogram);
+                }
+            }));
+
+            report("checksum", measure(config, [&]() {
+                for (size_t block = 0; block < blockCount; ++block) {
+                    volatile uint32_t crc = crc32c(blockData(block), blockLength(block));
+                    (void)crc;
+                }
+            }));
+        }
+        setCpuLevel(detectedCpuLevel()); // The other stages run as the compressor would
+
+        report("tree_build", measure(config, [&]() {
+            for (size_t block = 0; block < blockCount; ++block) {
+                FlatHuffmanTree tree;
+                HuffmanCodeTable table;
+                tree.build(histograms[block]);
+                tree.codeLengths(table);
+            }
+        }));
+
+        report("code_assignment", measure(config, [&]() {
+            for (size_t block = 0; block < blockCount; ++block) {
+                HuffmanCodeTable table;
+                buildLengthLimitedCodeLengths(histograms[block], maxLength, table);
+                buildCanonicalCodes(table);
+            }
+        }));
+
+        // The same payloads split four ways, as written with --streams=4
+        vector<array<vector<unsigned char>, 4>> quarters(blockCount);
+        for (size_t block = 0; block < blockCount; ++block) {
+            size_t length = blockLength(block);
+            for (unsigned s = 0; s < 4; ++s) {
+                size_t begin = static_cast<size_t>(min<uint64_t>(s * ((uint64_t(length) + 3) / 4), length));
+                encodeHuffman(blockData(block) + begin, static_cast<size_t>(interleavedStreamSymbols(length, s)), codes[block], quarters[block][s]);
+            }
+        }
+        vector<HuffmanDecodeTable> decodeTables(blockCount);
+        for (size_t block = 0; block < blockCount; ++block) {
+            decodeTables[block].build(codes[block]);
+        }
+
+        vector<vector<unsigned char>> payloads(blockCount);
+        string decoded;
+        for (CpuLevel level : config.cpuLevels) {
+            setCpuLevel(level);
+            report("encode", measure(config, [&]() {
+                for (size_t block = 0; block < blockCount; ++block) {
+                    payloads[block].clear();
+                    encodeHuffman(blockData(block), blockLength(block), codes[block], payloads[block]);
+                }
+            }));
+
+            report("decode", measure(config, [&]() {
+                for (size_t block = 0; block < blockCount; ++block) {
+                    decoded.clear();
+                    decodeTables[block].decode(payloads[block].data(), payloads[block].size(), blockLength(block), decoded);
+                }
+            }));
+
+            report("decode_four", measure(config, [&]() {
+                for (size_t block = 0; block < blockCount; ++block) {
+                    const unsigned char* streams[4];
+                    size_t sizes[4];
+                    for (unsigned s = 0; s < 4; ++s) {
+                        streams[s] = quarters[block][s].data();
+                        sizes[s] = quarters[block][s].size();
+                    }
+                    decoded.clear();
+                    decodeTables[block].decodeFour(streams, sizes, blockLength(block), decoded);
+                }
+            }));
+
+            // The timings mean nothing unless this level's encoder and decoders reproduce the input
+            for (size_t block = 0; block < blockCount; ++block) {
+                size_t length = blockLength(block);
+                decoded.clear();
+                decodeTables[block].decode(payloads[block].data(), payloads[block].size(), length, decoded);
+                checkRoundTrip(name, "decode", decoded, blockData(block), length);
+
+                const unsigned char* streams[4];
+                size_t sizes[4];
+                array<vector<unsigned char>, 4> streamData;
+                for (unsigned s = 0; s < 4; ++s) {
+                    size_t begin = static_cast<size_t>(min<uint64_t>(s * ((uint64_t(length) + 3) / 4), length));
+                    encodeHuffman(blockData(block) + begin, static_cast<size_t>(interleavedStreamSymbols(length, s)), codes[block], streamData[s]);
+                    streams[s] = streamData[s].data();
+                    sizes[s] = streamData[s].size();
+                }
+                decoded.clear();
+                decodeTables[block].decodeFour(streams, sizes, length, decoded);
+                checkRoundTrip(name, "decode_four", decoded, blockData(block), length);
+            }
+        }
+        setCpuLevel(detectedCpuLevel());
+
+        vector<HuffmanNode*> trees(blockCount);
+        for (size_t block = 0; block < blockCount; ++block) {
+            trees[block] = HuffmanNode::fromCodes(codes[block]);
+        }
+        report("decode_tree", measure(config, [&]() {
+            for (size_t block = 0; block < blockCount; ++block) {
+                decoded.clear();
+                trees[block]->decode(payloads[block].data(), payloads[block].size(), blockLength(block), decoded);
+            }
+        }));
+        for (HuffmanNode* tree : trees) {
+            delete tree;
+        }
+
+        // End to end in memory: the same per-block calls the file pipeline makes, once per entropy coder and LZ77 level,
+        // and once with checksums to show what verifying them costs
+        vector<unsigned char> compressed;
+        struct Variant {
+            compressor::Codec codec;
+            unsigned level;
+            bool checksum;
+            const char* suffix;
+        };
+        const Variant variants[] = {{compressor::Codec::Huffman, 0, false, ""}, {compressor::Codec::Huffman, 0, true, "_crc"},
+                                    {compressor::Codec::Ans, 0, false, "_ans"}, {compressor::Codec::Huffman, 1, false, "_lz1"},
+                                    {compressor::Codec::Huffman, 6, false, "_lz6"}};
+        for (const Variant& variant : variants) {
+            const char* suffix = variant.suffix;
+            compressor::CompressOptions options;
+            options.codec = variant.codec;
+            options.level = variant.level;
+            options.checksum = variant.checksum;
+            Measurement compression = measure(config, [&]() {
+                compressed.clear();
+                for (size_t block = 0; block < blockCount; ++block) {
+                    compressor::compressBlock(blockData(block), blockLength(block), compressed, options);
+                }
+            });
+            report(string("compress_memory") + suffix, compression, static_cast<double>(data.size()) / compressed.size());
+
+            report(string("decompress_memory") + suffix, measure(config, [&]() {
+                size_t pos = 0;
+                for (size_t block = 0; block < blockCount; ++block) {
+                    size_t compressedSize = 0;
+                    for (unsigned i = 0; i < 4; ++i) {
+                        compressedSize |= size_t(compressed[pos + 4 + i]) << (8 * i);
+                    }
+                    decoded.clear();
+                    compressor::decompressBlock(&compressed[pos + 8], compressedSize, blockLength(block), decoded);
+                    pos += 8 + compressedSize;
+                }
+            }));
+
+            string restored;
+            size_t pos = 0;
+            for (size_t block = 0; block < blockCount; ++block) {
+                size_t compressedSize = 0;
+                for (unsigned i = 0; i < 4; ++i) {
+                    compressedSize |= size_t(compressed[pos + 4 + i]) << (8 * i);
+                }
+                compressor::decompressBlock(&compressed[pos + 8], compressedSize, blockLength(block), restored);
+                pos += 8 + compressedSize;
+            }
+            checkRoundTrip(name, string("decompress_memory") + suffix, restored, data.data(), data.size());
+        }
+
+        // Reusable contexts: after the first iteration the buffers fit, so these should not allocate
+        compressor::Compressor context;
+        vector<unsigned char> message;
+        Measurement contextCompression = measure(config, [&]() {
+            message.clear();
+            context.compress(data.data(), data.size(), message);
+        });
+        report("context_compress", contextCompression, static_cast<double>(data.size()) / message.size());
+
+        compressor::Decompressor decompressionContext;
+        report("context_decompress", measure(config, [&]() {
+            decoded.clear();
+            decompressionContext.decompress(message.data(), message.size(), decoded);
+        }));
+
+        if (!config.fileStages) {
+            return;
+        }
+
+        // End to end through files, at each thread count
+        fs::path directory = fs::temp_directory_path() / ("compressor_bench_" + to_string(getpid()));
+        fs::create_directories(directory);
+        fs::path input = directory / "input";
+        fs::path output = directory / "output.huf";
+        fs::path restored = directory / "restored";
+        {
+            ofstream file(input, ios::binary);
+            file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        }
+
+        for (unsigned threads : config.threads) {
+            compressor::CompressOptions compressOptions;
+            compressOptions.threads = threads;
+            compressor::DecompressOptions decompressOptions;
+            decompressOptions.threads = threads;
+
+            Measurement compressRun = measure(config, [&]() { compressor::compress(input.string(), output.string(), compressOptions); });
+            Measurement decompressRun = measure(config, [&]() { compressor::decompress(output.string(), restored.string(), decompressOptions); });
+
+            report("compress_file", compressRun, static_cast<double>(data.size()) / fs::file_size(output), threads);
+            report("decompress_file", decompressRun, 0, threads);
+        }
+
+        // Archive round trip of a small tree: the file and the empty directory must come back, the symbolic links must not
+        fs::path tree = directory / "tree";
+        fs::path archiveFile = directory / "tree.hufa";
+        fs::path extracted = directory / "extracted";
+        fs::create_directories(tree / "files");
+        fs::create_directories(tree / "empty");
+        fs::copy_file(input, tree / "files" / "input");
+        error_code linkError;
+        fs::create_symlink("input", tree / "files" / "link", linkError);
+        fs::create_directory_symlink("files", tree / "dirlink", linkError);
+        for (unsigned threads : config.threads) {
+            compressor::CompressOptions compressOptions;
+            compressOptions.threads = threads;
+            compressor::DecompressOptions decompressOptions;
+            decompressOptions.threads = threads;
+
+            Measurement archiveRun = measure(config, [&]() { compressor::archive(tree.string(), archiveFile.string(), compressOptions); });
+            Measurement extractRun = measure(config, [&]() {
+                fs::remove_all(extracted);
+                compressor::extractArchive(archiveFile.string(), extracted.string(), decompressOptions);
+            });
+            report("archive_file", archiveRun, static_cast<double>(data.size()) / fs::file_size(archiveFile), threads);
+            report("extract_archive_file", extractRun, 0, threads);
+
+            ifstream file(extracted / "files" / "input", ios::binary);
+            string restoredData((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+            checkRoundTrip(name, "extract_archive_file", restoredData, data.data(), data.size());
+            if (!fs::is_directory(extracted / "empty") || fs::exists(fs::symlink_status(extracted / "files" / "link"))
+                || fs::exists(fs::symlink_status(extracted / "dirlink"))) {
+                cerr << "Round trip failed: " << name << " extract_archive_file kept a symbolic link or lost an empty directory" << endl;
+                roundTripFailed = true;
+            }
+        }
+        fs::remove_all(directory);
+    }
+
+    // Parses a size with an optional K or M suffix
+    bool parseSize(const string& text, size_t& value) {
+        size_t end = 0;
+        try {
+            value = stoull(text, &end);
+        } catch (const exception&) {
+            return false;
+        }
+        string suffix = text.substr(end);
+        if (suffix == "K" || suffix == "k") {
+            value <<= 10;
+        } else if (suffix == "M" || suffix == "m") {
+            value <<= 20;
+        } else if (!suffix.empty()) {
+            return false;
+        }
+        return value > 0;
+    }
+
+    vector<string> split(const string& text) {
+        vector<string> parts;
+        stringstream stream(text);
+        string part;
+        while (getline(stream, part, ',')) {
+            parts.push_back(part);
+        }
+        return parts;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool valid = true;
+        if (arg.rfind("--sizes=", 0) == 0) {
+            config.sizes.clear();
+            for (const string& part : split(arg.substr(8))) {
+                size_t size = 0;
+                valid = valid && parseSize(part, size);
+                config.sizes.push_back(size);
+            }
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            config.threads.clear();
+            for (const string& part : split(arg.substr(10))) {
+                valid = valid && !part.empty() && part.find_first_not_of("0123456789") == string::npos;
+                config.threads.push_back(valid ? static_cast<unsigned>(stoul(part)) : 1);
+            }
+        } else if (arg.rfind("--min-time=", 0) == 0) {
+            config.minTime = atof(arg.substr(11).c_str());
+        } else if (arg == "--format=json" || arg == "--format=csv") {
+            config.format = arg.substr(9);
+        } else if (arg.rfind("--corpus-dir=", 0) == 0) {
+            config.corpusDir = arg.substr(13);
+        } else if (arg == "--no-file") {
+            config.fileStages = false;
+        } else if (arg.rfind("--cpu=", 0) == 0) {
+            for (const string& part : split(arg.substr(6))) {
+                CpuLevel level = CpuLevel::Scalar;
+                valid = valid && parseCpuLevel(part, level) && level <= detectedCpuLevel();
+                config.cpuLevels.push_back(level);
+            }
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            cerr << "Usage: " << argv[0] << " [--sizes=64K,1M,16M] [--threads=1,2,4] [--min-time=SECONDS]"
+                 << " [--format=json|csv] [--corpus-dir=DIR] [--no-file] [--cpu=scalar,sse4.2,avx2]" << endl;
+            return 1;
+        }
+    }
+    if (config.cpuLevels.empty()) {
+        for (CpuLevel level : {CpuLevel::Scalar, CpuLevel::Sse42, CpuLevel::Avx2}) {
+            if (level <= detectedCpuLevel()) {
+                config.cpuLevels.push_back(level);
+            }
+        }
+    }
+
+    printHeader(config);
+    for (size_t size : config.sizes) {
+        benchCorpus(config, "text", makeText(config, size));
+        benchCorpus(config, "binary", makeBinary(size));
+        benchCorpus(config, "lowentropy", makeLowEntropy(size));
+        benchCorpus(config, "sparse", makeSparse(size));
+        benchCorpus(config, "twosymbol", makeTwoSymbol(size));
+        benchCorpus(config, "random", makeRandom(size));
+    }
+    return roundTripFailed ? 1 : 0;
+}
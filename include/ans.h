@@ -0,0 +1,130 @@
+#ifndef ANS_H
+#define ANS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @file ans.h
+ * @brief Table-based asymmetric numeral systems (tANS) entropy coder.
+ *
+ * Byte counts are scaled to a power-of-two total, one slot per unit, and the
+ * coder moves between that many states. Unlike Huffman codes, a symbol can
+ * cost a fraction of a bit, which matters for heavily skewed data. Encoding
+ * runs backwards over the input so decoding runs forwards with one table
+ * lookup and one bit read per symbol.
+ */
+
+constexpr unsigned ANS_MIN_TABLE_LOG = 8;  ///< Smallest table: enough slots for all 256 byte values
+constexpr unsigned ANS_MAX_TABLE_LOG = 12; ///< Largest table; its decoder fits in L1 cache
+
+/**
+ * @brief Byte counts scaled to sum to 1 << tableLog.
+ */
+struct AnsCounts {
+    std::array<uint16_t, 256> counts{}; ///< Slots per byte value; 0 if the value does not occur
+    unsigned tableLog = ANS_MAX_TABLE_LOG; ///< log2 of the number of states
+};
+
+/**
+ * @brief Scale byte counts to a table, keeping every occurring value at least one slot.
+ * @param histogram Number of occurrences of each byte value.
+ * @param total Sum of histogram; must not be 0.
+ * @param normalized Receives the scaled counts; the table size is chosen from total.
+ */
+void normalizeAnsCounts(const std::array<uint64_t, 256>& histogram, uint64_t total, AnsCounts& normalized);
+
+/**
+ * @brief Estimate the coded size of data with a histogram.
+ * @param histogram Number of occurrences of each byte value.
+ * @param normalized Counts from normalizeAnsCounts.
+ * @return Payload bits, ignoring the final state and padding.
+ */
+uint64_t ansCodedBits(const std::array<uint64_t, 256>& histogram, const AnsCounts& normalized);
+
+/**
+ * @brief Append the table log and the scaled counts.
+ *
+ * Counts up to 64 take one byte and larger ones two; runs of absent byte
+ * values are stored as 0x80 | (n - 1) like Huffman code lengths.
+ * @param normalized The counts.
+ * @param out Buffer to append to.
+ */
+void writeAnsCounts(const AnsCounts& normalized, std::vector<unsigned char>& out);
+
+/**
+ * @brief Read counts written by writeAnsCounts.
+ * @param data Pointer to the counts.
+ * @param size Bytes available.
+ * @param normalized Receives the counts.
+ * @return Bytes consumed, or 0 if the counts are malformed or do not fill the table exactly.
+ */
+size_t readAnsCounts(const unsigned char* data, size_t size, AnsCounts& normalized);
+
+/**
+ * @brief tANS encoder for one set of counts.
+ *
+ * Holds its tables in fixed arrays, so it can live on the stack of each
+ * thread coding a block.
+ */
+class AnsEncoder {
+public:
+    /**
+     * @brief Build the state transition tables.
+     * @param normalized Counts from normalizeAnsCounts or readAnsCounts.
+     */
+    void build(const AnsCounts& normalized);
+
+    /**
+     * @brief Append the coded form of data: a padding byte, then the bit stream.
+     *
+     * Every byte of data must have a nonzero count.
+     * @param data Pointer to the bytes.
+     * @param size Number of bytes.
+     * @param out Buffer to append to.
+     */
+    void encode(const unsigned char* data, size_t size, std::vector<unsigned char>& out) const;
+
+private:
+    /// Per byte value: offsets turning a state into its output bit count and next state
+    struct Transform {
+        int32_t deltaBits = 0;
+        int32_t deltaState = 0;
+    };
+
+    unsigned tableLog = 0;
+    std::array<Transform, 256> transforms{};
+    std::array<uint16_t, 1 << ANS_MAX_TABLE_LOG> nextStates{};
+};
+
+/**
+ * @brief tANS decoder for one set of counts.
+ */
+class AnsDecodeTable {
+public:
+    /**
+     * @brief Build the decoding table.
+     * @param normalized Counts from readAnsCounts.
+     */
+    void build(const AnsCounts& normalized);
+
+    /**
+     * @brief Decode a fixed number of bytes.
+     * @param data Pointer to the padding byte and bit stream written by AnsEncoder::encode.
+     * @param size Number of bytes available.
+     * @param count Number of bytes to decode.
+     * @param out String receiving the decoded bytes.
+     * @return False if the stream is malformed or too short.
+     */
+    bool decode(const unsigned char* data, size_t size, uint64_t count, std::string& out) const;
+
+private:
+    // Entry layout: bits 0-7 byte value, bits 8-15 bits to read, bits 16-31 base of the next state
+    unsigned tableLog = 0;
+    std::array<uint32_t, 1 << ANS_MAX_TABLE_LOG> entries{};
+};
+
+#endif // ANS_H
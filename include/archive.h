@@ -0,0 +1,84 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "compressor.h"
+#include <string>
+
+/**
+ * @file archive.h
+ * @brief Multi-file archives built from a directory tree.
+ *
+ * An archive stores each file as a complete compressed stream (see
+ * compressor.h), followed by a central index and a trailer. All integers are
+ * little-endian.
+ *
+ * | Size | Field            |
+ * |------|------------------|
+ * | 4    | Magic "HUFA"     |
+ * | 1    | Archive version  |
+ * | var  | Member streams   |
+ *
+ * Central index, one entry per member in path order:
+ *
+ * | Size | Field                                              |
+ * |------|----------------------------------------------------|
+ * | 2    | Path length in bytes                               |
+ * | var  | Path relative to the archived directory, '/' separated |
+ * | 8    | File offset of the member stream                   |
+ * | 8    | Size of the member stream                          |
+ * | 8    | Uncompressed size of the member                    |
+ *
+ * Directories (version 2 and later) are entries whose path ends in '/' and
+ * whose offset and sizes are 0; they have no stream and are recreated on
+ * extraction, so empty directories survive the round trip.
+ *
+ * Trailer:
+ *
+ * | Size | Field                            |
+ * |------|----------------------------------|
+ * | 8    | File offset of the central index |
+ * | 4    | Number of index entries          |
+ * | 4    | Magic "HUFD"                     |
+ */
+namespace compressor {
+    extern const char ARCHIVE_MAGIC[4];          ///< Identifies archives
+    extern const unsigned char ARCHIVE_VERSION;  ///< Version of the archive layout
+
+    /**
+     * @brief Compress every regular file below a directory into one archive.
+     *
+     * Subdirectories are recorded in the index; symbolic links are skipped.
+     * Small files are compressed whole and large files block by block, as
+     * separate tasks on a work-stealing pool, so a few huge files among many
+     * tiny ones still keep every thread busy. Members are written in path order,
+     * so the archive does not depend on the thread count.
+     * @param inputDirectory The directory to archive.
+     * @param archiveFileName The archive to create.
+     * @param options Block size, thread and code length settings.
+     * @return False if a file cannot be read or the archive cannot be written.
+     */
+    bool archive(const std::string& inputDirectory, const std::string& archiveFileName, const CompressOptions& options = CompressOptions());
+
+    /**
+     * @brief Extract every member of an archive below a directory.
+     *
+     * Blocks of all members are decoded in parallel and written straight to
+     * their place in the output files. Paths that would leave the output
+     * directory are rejected.
+     * @param archiveFileName The archive to read.
+     * @param outputDirectory Directory receiving the files; created if missing.
+     * @param options Decoder and thread settings.
+     * @return False if the archive is damaged or a file cannot be written.
+     */
+    bool extractArchive(const std::string& archiveFileName, const std::string& outputDirectory, const DecompressOptions& options = DecompressOptions());
+
+    /**
+     * @brief Decode every member of an archive and check its blocks, without writing anything.
+     * @param archiveFileName The archive to read.
+     * @param options Decoder and thread settings.
+     * @return False, after printing an error naming the member and block, if the archive is damaged.
+     */
+    bool verifyArchive(const std::string& archiveFileName, const DecompressOptions& options = DecompressOptions());
+}
+
+#endif // ARCHIVE_H
@@ -0,0 +1,154 @@
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * @brief Load eight bytes as a big-endian integer so the first stream bit lands in bit 63.
+ * @param ptr Pointer to at least eight readable bytes.
+ * @return The loaded value.
+ */
+inline uint64_t loadBigEndian64(const unsigned char* ptr) {
+    uint64_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+/**
+ * @brief Store a value as eight big-endian bytes.
+ * @param ptr Pointer to at least eight writable bytes.
+ * @param value The value to store.
+ */
+inline void storeBigEndian64(unsigned char* ptr, uint64_t value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    std::memcpy(ptr, &value, sizeof(value));
+}
+
+/**
+ * @brief Packs variable-length codes into a byte buffer, most significant bit first.
+ *
+ * Codes collect in a 64-bit accumulator that is flushed to the buffer one
+ * whole word at a time.
+ */
+class BitWriter {
+public:
+    /**
+     * @brief Construct a writer appending to a buffer.
+     * @param out The buffer receiving the packed bytes.
+     */
+    explicit BitWriter(std::vector<unsigned char>& out) : out(out) {}
+
+    /**
+     * @brief Append a code.
+     * @param code The code bits, right-aligned.
+     * @param length The number of bits in code (at most 57).
+     */
+    void put(uint64_t code, unsigned length) {
+        if (bitCount + length < 64) {
+            accumulator = (accumulator << length) | code;
+            bitCount += length;
+            return;
+        }
+        // Fill the accumulator, write it out and keep the bits that did not fit
+        unsigned spill = bitCount + length - 64;
+        accumulator = (accumulator << (length - spill)) | (code >> spill);
+        size_t size = out.size();
+        out.resize(size + 8);
+        storeBigEndian64(out.data() + size, accumulator);
+        accumulator = code & ((uint64_t(1) << spill) - 1);
+        bitCount = spill;
+    }
+
+    /**
+     * @brief Write any buffered bits, padding the last byte with zeros.
+     */
+    void flush() {
+        while (bitCount >= 8) {
+            bitCount -= 8;
+            out.push_back(static_cast<unsigned char>(accumulator >> bitCount));
+        }
+        if (bitCount > 0) {
+            out.push_back(static_cast<unsigned char>(accumulator << (8 - bitCount)));
+        }
+        accumulator = 0;
+        bitCount = 0;
+    }
+
+private:
+    std::vector<unsigned char>& out; ///< Destination buffer
+    uint64_t accumulator = 0;        ///< Pending bits, right-aligned
+    unsigned bitCount = 0;           ///< Number of pending bits
+};
+
+/**
+ * @brief Reads fields written by BitWriter, most significant bit first.
+ *
+ * Bits are loaded eight bytes at a time into a left-aligned 64-bit buffer.
+ * Reading past the end yields zero bits; overrun() reports it afterwards, so
+ * the hot path needs no bounds checks.
+ */
+class BitReader {
+public:
+    /**
+     * @brief Construct a reader over a buffer.
+     * @param data Pointer to the packed bytes.
+     * @param size Number of bytes.
+     */
+    BitReader(const unsigned char* data, size_t size) : data(data), size(size) {}
+
+    /**
+     * @brief Read a field.
+     * @param length Number of bits (at most 56).
+     * @return The field, right-aligned.
+     */
+    uint64_t read(unsigned length) {
+        if (bitCount < length) {
+            refill();
+        }
+        uint64_t value = (bitBuffer >> 1) >> (63 - length); // Two shifts so that 0 bits is valid
+        bitBuffer <<= length;
+        bitCount = bitCount > length ? bitCount - length : 0;
+        bitsRead += length;
+        return value;
+    }
+
+    /**
+     * @brief Check whether more bits were read than the buffer holds.
+     * @return True if a read ran past the end.
+     */
+    bool overrun() const {
+        return bitsRead > uint64_t(size) * 8;
+    }
+
+private:
+    // Loads whole bytes until at least 56 bits are buffered or the input is exhausted
+    void refill() {
+        if (pos + 8 <= size) {
+            bitBuffer |= loadBigEndian64(data + pos) >> bitCount;
+            pos += (63 - bitCount) >> 3;
+            bitCount |= 56;
+            return;
+        }
+        while (bitCount <= 56 && pos < size) {
+            bitBuffer |= uint64_t(data[pos++]) << (56 - bitCount);
+            bitCount += 8;
+        }
+    }
+
+    const unsigned char* data; ///< Source buffer
+    size_t size;               ///< Bytes in the source buffer
+    size_t pos = 0;            ///< Next byte to load
+    uint64_t bitBuffer = 0;    ///< Unread bits, left-aligned
+    unsigned bitCount = 0;     ///< Number of valid bits in bitBuffer
+    uint64_t bitsRead = 0;     ///< Bits consumed so far
+};
+
+#endif // BITSTREAM_H
@@ -0,0 +1,81 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/**
+ * @brief First-in first-out queue between pipeline stages that holds at most a fixed number of items.
+ *
+ * A producer that gets ahead of its consumer blocks in push until an item is
+ * taken, so a fast reader cannot pile up more blocks in memory than the
+ * queue allows.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    /**
+     * @brief Create an empty queue.
+     * @param capacity Most items held at once (at least one).
+     */
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /**
+     * @brief Append an item, waiting while the queue is full.
+     * @param item The item.
+     */
+    void push(T item) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [this]() { return items.size() < capacity; });
+            items.push_back(std::move(item));
+        }
+        notEmpty.notify_one();
+    }
+
+    /**
+     * @brief Take the oldest item, waiting while the queue is empty and open.
+     * @param item Receives the item.
+     * @return False once the queue is closed and every item has been taken.
+     */
+    bool pop(T& item) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this]() { return !items.empty() || closed; });
+            if (items.empty()) {
+                return false;
+            }
+            item = std::move(items.front());
+            items.pop_front();
+        }
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Mark the end of the items; pop returns false once the rest are taken.
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        notEmpty.notify_all();
+    }
+
+private:
+    std::deque<T> items;                 ///< Items in arrival order
+    size_t capacity;                     ///< Most items held at once
+    std::mutex mutex;                    ///< Guards items and closed
+    std::condition_variable notFull;     ///< Signalled when an item is taken
+    std::condition_variable notEmpty;    ///< Signalled when an item is added or the queue closes
+    bool closed = false;                 ///< Set by close
+};
+
+#endif // BOUNDED_QUEUE_H
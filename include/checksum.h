@@ -0,0 +1,27 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file checksum.h
+ * @brief CRC-32C (Castagnoli) checksums of uncompressed data.
+ *
+ * Uses the SSE4.2 crc32 instruction when cpuLevel() allows it and a
+ * table-driven loop otherwise; both give the same result.
+ */
+
+/**
+ * @brief Compute the CRC-32C of a buffer.
+ *
+ * A buffer checksummed in pieces gives the same result as in one call if
+ * each call is passed the result of the previous one.
+ * @param data Pointer to the bytes.
+ * @param size Number of bytes.
+ * @param crc Checksum of the bytes before data, or 0 to start.
+ * @return Checksum of everything up to the end of data.
+ */
+uint32_t crc32c(const unsigned char* data, size_t size, uint32_t crc = 0);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,204 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "compressor.h"
+#include "fileHandles.h"
+#include "format.h"
+#include "huffman.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace compressor {
+    /**
+     * @brief Reusable compression context for data held in memory.
+     *
+     * Produces the same format that compress() writes to files, so either side
+     * can read what the other wrote. A context holds all of its state, so
+     * separate contexts can be used on separate threads at the same time; one
+     * context must not be shared between threads without locking. Buffers and
+     * tables are kept between calls, so once they have grown to fit a message,
+     * compressing further messages of that size does not allocate.
+     *
+     * Whole messages go through compress(). Data arriving in pieces can be fed
+     * with push(), ended with finish() and collected with pull() as it becomes
+     * available; reset() starts the next message. compress() keeps its own
+     * state, so it may be called while a pushed message is in progress.
+     */
+    class Compressor {
+    public:
+        /**
+         * @brief Create a context.
+         * @param options Block size, code length limit and dictionary; the thread count is ignored.
+         */
+        explicit Compressor(const CompressOptions& options = CompressOptions());
+
+        /**
+         * @brief Compress a whole message.
+         * @param data Pointer to the uncompressed bytes.
+         * @param size Number of uncompressed bytes.
+         * @param out Buffer the compressed message is appended to.
+         */
+        void compress(const unsigned char* data, size_t size, std::vector<unsigned char>& out);
+
+        /**
+         * @brief Compress a whole message.
+         * @param input The uncompressed bytes.
+         * @param out Buffer the compressed message is appended to.
+         */
+        void compress(fileHandles::ByteSpan input, std::vector<unsigned char>& out);
+
+        /**
+         * @brief Add uncompressed data to the current message.
+         *
+         * Every complete block is compressed straight away; pull() the output
+         * regularly so it does not accumulate.
+         * @param data Pointer to the bytes.
+         * @param size Number of bytes.
+         * @return False if finish() was already called for this message.
+         */
+        bool push(const unsigned char* data, size_t size);
+
+        /**
+         * @brief End the current message, compressing the last partial block and writing the seek index.
+         */
+        void finish();
+
+        /**
+         * @brief Take compressed output.
+         * @param dest Buffer receiving the bytes.
+         * @param capacity Size of dest.
+         * @return Number of bytes copied.
+         */
+        size_t pull(unsigned char* dest, size_t capacity);
+
+        /**
+         * @brief Get the number of compressed bytes waiting to be pulled.
+         * @return Bytes available.
+         */
+        size_t available() const;
+
+        /**
+         * @brief Check whether the message is finished and all of its output pulled.
+         * @return True when the next call should be reset().
+         */
+        bool done() const;
+
+        /**
+         * @brief Discard any partial message and start a new one, keeping the buffers.
+         */
+        void reset();
+
+    private:
+        void begin();
+        void appendBlock(const unsigned char* data, size_t size);
+
+        CompressOptions options;              ///< Coding settings
+        size_t blockSize;                     ///< Options' block size clamped to the accepted range
+        std::vector<unsigned char> input;     ///< Partial block waiting for more data
+        std::vector<unsigned char> output;    ///< Compressed bytes not yet pulled
+        size_t outputPos = 0;                 ///< First byte of output not yet pulled
+        std::vector<unsigned char> seekIndex; ///< Index entries of the blocks written so far
+        TableLink tables;                     ///< Table the next pushed block may reuse
+        std::vector<unsigned char> messageIndex; ///< Index entries of the message being written by compress()
+        TableLink messageTables;              ///< Table the next block written by compress() may reuse
+        uint64_t produced = 0;                ///< Compressed bytes produced for the current message
+        bool started = false;                 ///< The file header has been written
+        bool finished = false;                ///< finish() has been called
+    };
+
+    /**
+     * @brief Reusable decompression context for data held in memory.
+     *
+     * Reads the format written by compress() and Compressor. Like Compressor,
+     * a context is self-contained apart from the read-only dictionary it may
+     * share, and keeps its decoder tables and buffers between calls. Streamed input is decoded block by block as soon as each
+     * block is complete, without needing the seek index at the end.
+     */
+    class Decompressor {
+    public:
+        /**
+         * @brief Create a context.
+         * @param options The dictionary, if data was compressed with one; decoder and thread count are ignored.
+         */
+        explicit Decompressor(const DecompressOptions& options = DecompressOptions());
+
+        /**
+         * @brief Decompress a whole message.
+         * @param data Pointer to the compressed bytes.
+         * @param size Number of compressed bytes.
+         * @param out String the uncompressed bytes are appended to.
+         * @return False if the data is corrupt, truncated or followed by extra bytes.
+         */
+        bool decompress(const unsigned char* data, size_t size, std::string& out);
+
+        /**
+         * @brief Decompress a whole message.
+         * @param input The compressed bytes.
+         * @param out String the uncompressed bytes are appended to.
+         * @return False if the data is corrupt, truncated or followed by extra bytes.
+         */
+        bool decompress(fileHandles::ByteSpan input, std::string& out);
+
+        /**
+         * @brief Add compressed data and decode every block it completes.
+         * @param data Pointer to the bytes.
+         * @param size Number of bytes.
+         * @return False once the data is found to be corrupt; the context then stays failed until reset().
+         */
+        bool push(const unsigned char* data, size_t size);
+
+        /**
+         * @brief Take decoded output.
+         * @param dest Buffer receiving the bytes.
+         * @param capacity Size of dest.
+         * @return Number of bytes copied.
+         */
+        size_t pull(unsigned char* dest, size_t capacity);
+
+        /**
+         * @brief Get the number of decoded bytes waiting to be pulled.
+         * @return Bytes available.
+         */
+        size_t available() const;
+
+        /**
+         * @brief Check whether the whole message, seek index included, has been read and all output pulled.
+         * @return True when the message is complete.
+         */
+        bool done() const;
+
+        /**
+         * @brief Check whether corrupt data has been seen.
+         * @return True if the context failed.
+         */
+        bool failed() const;
+
+        /**
+         * @brief Start a new message, keeping the buffers.
+         */
+        void reset();
+
+    private:
+        /// What the parser expects next
+        enum class State { Header, Blocks, Index, Done, Failed };
+
+        size_t parse(const unsigned char* data, size_t size, std::string& out);
+
+        State state = State::Header;         ///< Parser position
+        uint64_t blockSize = 0;              ///< Largest block, from the file header
+        uint64_t blockCount = 0;             ///< Blocks decoded so far
+        uint64_t consumed = 0;               ///< Compressed bytes parsed so far
+        HuffmanDecodeTable table;            ///< Decoder, rebuilt for each block
+        std::vector<unsigned char> lastTable; ///< Mode byte and code lengths of the latest block storing a table
+        uint64_t lastTableBlock = 0;         ///< Number of that block
+        std::shared_ptr<const Dictionary> dictionary; ///< Codes of dictionary-coded blocks, or null
+        std::vector<unsigned char> input;    ///< Incomplete block waiting for more data
+        std::string output;                  ///< Decoded bytes not yet pulled
+        size_t outputPos = 0;                ///< First byte of output not yet pulled
+    };
+}
+
+#endif // CODEC_H
@@ -1,20 +1,208 @@
 #ifndef COMPRESSOR_H
 #define COMPRESSOR_H
 #include "huffman.h"
+#include "stats.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 #include<map>
 
 /**
  * @namespace compressor
  * @brief Namespace containing functions and data structures for file compression and decompression.
+ *
+ * Compressed files are a stream of independently coded blocks, so memory use
+ * is bounded by the block size rather than the file size. All integers are
+ * little-endian.
+ *
+ * File header:
+ *
+ * | Size | Field                                       |
+ * |------|---------------------------------------------|
+ * | 4    | Magic "HUFZ"                                |
+ * | 1    | Format version                              |
+ * | 4    | Block size (largest uncompressed block)     |
+ * | 4    | Dictionary id (0 if none, see dictionary.h) |
+ *
+ * Each block, repeated until an end-of-stream marker block whose two size
+ * fields are 0:
+ *
+ * | Size | Field                                                         |
+ * |------|---------------------------------------------------------------|
+ * | 4    | Uncompressed size in bytes                                    |
+ * | 4    | Compressed size in bytes (everything below)                   |
+ * | 1    | Block mode (see below)                                        |
+ * | var  | Canonical code lengths of byte values 0-255, run-length coded |
+ * | var  | Huffman-coded payload, most significant bit first             |
+ *
+ * The blocks are followed by a seek index holding, for each block, the file
+ * offset of its header (8 bytes) and its uncompressed size (4 bytes), and then
+ * a fixed trailer:
+ *
+ * | Size | Field                    |
+ * |------|--------------------------|
+ * | 8    | File offset of the index |
+ * | 4    | Number of blocks         |
+ * | 4    | Magic "HUFI"             |
+ *
+ * Each code length byte is either a length (0x00-0x7F) for the next byte
+ * value or 0x80 | (n - 1) for a run of n byte values without a code.
+ *
+ * The block mode says what follows it: 0 = code lengths and payload,
+ * 1 = payload coded with the dictionary, 2 = the uncoded bytes, 3 = a single
+ * byte value repeated for the whole block, 4 = a 4-byte count of blocks back
+ * to the most recent mode 0 block, whose code lengths are reused, then the
+ * payload, 5 = scaled byte counts and a tANS bit stream (see ans.h),
+ * 6 = LZ77 sequences (see lz77.h). Blocks are stored raw when coding would not
+ * make them smaller.
+ *
+ * In Table, Dictionary, Repeat and LZ77 blocks, 0x80 may be added to the mode
+ * byte. Each Huffman-coded payload of the block is then split into four bit
+ * streams: the first three hold (n + 3) / 4 consecutive bytes each and the
+ * last one the rest, and a jump table of the byte sizes of the first three
+ * streams (4 bytes each) comes before them.
+ *
+ * 0x40 may be added to the mode byte of any block. The block then ends with
+ * the CRC-32C (see checksum.h) of its uncompressed bytes, 4 bytes, which is
+ * checked whenever the block is decoded.
+ *
+ * An LZ77 block holds a 4-byte sequence count and a 4-byte literal count,
+ * then four streams: the literal bytes and, one byte per sequence, the codes
+ * of the literal lengths, match lengths and distances. Each stream has its
+ * own code lengths, a 4-byte payload size and its payload. Last come a 4-byte
+ * size and the extra bits of every length and distance, in sequence order.
  */
 namespace compressor{
-    extern std::map<char, unsigned> frequencyMap;
-    extern std::map<char, std::string> HuffmanCode;
-    extern MinHeap theHeap;
-    
-    void compress(const std::string& inputFileName, const std::string& outputFileName);
-    void decompress(const std::string& inputFileName, const std::string& outputFileName);
+    struct Dictionary;
+    extern const char FILE_MAGIC[4];          ///< Identifies compressed files
+    extern const unsigned char FORMAT_VERSION; ///< Version of the compressed file layout
+    extern const size_t DEFAULT_BLOCK_SIZE;    ///< Block size used unless configured otherwise
+    extern const size_t MIN_BLOCK_SIZE;        ///< Smallest accepted block size
+    extern const size_t MAX_BLOCK_SIZE;        ///< Largest accepted block size
+    extern const unsigned DEFAULT_MAX_CODE_LENGTH; ///< Code length limit used unless configured otherwise
+    extern const unsigned MIN_CODE_LENGTH_LIMIT;   ///< Smallest accepted code length limit
+    extern const unsigned MAX_CODE_LENGTH_LIMIT;   ///< Largest accepted code length limit
+
+    /**
+     * @brief Selects the Huffman decoder used by decompress.
+     */
+    enum class DecoderType {
+        Tree,  ///< Walk the Huffman tree one bit at a time
+        Table  ///< Multi-bit table lookups (default)
+    };
+
+    /**
+     * @brief Entropy coder preferred for blocks coded with a table of their own.
+     *
+     * Both coders are priced for every such block and the smaller is kept;
+     * the preference only decides blocks where they cost the same.
+     */
+    enum class Codec {
+        Huffman,  ///< Canonical Huffman codes (default)
+        Ans       ///< Table-based asymmetric numeral systems; closer to the entropy on skewed data
+    };
+
+    /**
+     * @brief Settings for decompress and extract.
+     */
+    struct DecompressOptions {
+        DecoderType decoder = DecoderType::Table; ///< Decoder used for each block
+        unsigned threads = 1;                     ///< Worker threads decoding blocks (0 = one per hardware thread)
+        std::shared_ptr<const Dictionary> dictionary; ///< Needed for data compressed with a dictionary
+    };
+
+    /**
+     * @brief Settings for compress.
+     */
+    struct CompressOptions {
+        size_t blockSize = DEFAULT_BLOCK_SIZE; ///< Uncompressed bytes per block
+        unsigned threads = 1;                  ///< Worker threads coding blocks (0 = one per hardware thread)
+        unsigned maxCodeLength = DEFAULT_MAX_CODE_LENGTH; ///< Longest Huffman code in bits
+        std::shared_ptr<const Dictionary> dictionary;     ///< Trained codes used where they beat a table of the block's own
+        Codec codec = Codec::Huffman;                     ///< Coder kept when both cost the same for a block
+        unsigned level = 0;                               ///< LZ77 search effort, 1-9; 0 codes bytes without matches
+        unsigned streams = 1;                             ///< Bit streams per Huffman payload, 1 or 4; 4 decodes faster
+        bool checksum = false;                            ///< End each block with a CRC-32C of its uncompressed bytes
+    };
+
+    /**
+     * @brief Compress one block and append it, header included, to a buffer.
+     *
+     * The block is stored raw, as a run, with the dictionary's codes, with
+     * a table of its own for whichever codec is smaller or, if an LZ77 level is set,
+     * as matches and literals, whichever is smallest. Safe to call from
+     * several threads at once.
+     * @param data Pointer to the uncompressed bytes.
+     * @param size Number of uncompressed bytes (at most MAX_BLOCK_SIZE).
+     * @param out Buffer receiving the compressed block.
+     * @param options Coding settings (code length limit, dictionary, codec, LZ77 level, streams and checksum).
+     * @return Size figures and stage times for the block.
+     */
+    BlockStats compressBlock(const unsigned char* data, size_t size, std::vector<unsigned char>& out, const CompressOptions& options = CompressOptions());
+
+    /**
+     * @brief Decode the code lengths and payload of one block.
+     * @param data Pointer to the code lengths and payload.
+     * @param size Number of compressed bytes.
+     * @param originalSize Number of uncompressed bytes in the block.
+     * @param out String receiving the decoded bytes.
+     * @param decoder The decoder to use.
+     * @param dictionary The dictionary the block may be coded with, or null.
+     * @param tableBlock For blocks reusing an earlier block's table, that block after its header; otherwise null.
+     * @param tableBlockSize Bytes available at tableBlock.
+     * @return False if the block is corrupt, its checksum does not match, or it needs a dictionary or table that was not given.
+     */
+    bool decompressBlock(const unsigned char* data, size_t size, size_t originalSize, std::string& out, DecoderType decoder = DecoderType::Table,
+                         const Dictionary* dictionary = nullptr, const unsigned char* tableBlock = nullptr, size_t tableBlockSize = 0);
+
+    /**
+     * @brief Compress a file block by block.
+     * @param inputFileName The file to compress.
+     * @param outputFileName The file receiving the compressed data.
+     * @param options Block size, thread and code length settings.
+     * @param stats If not null, receives timings and size figures for the run.
+     * @return False if a file cannot be read or written.
+     */
+    bool compress(const std::string& inputFileName, const std::string& outputFileName, const CompressOptions& options = CompressOptions(),
+                  RunStats* stats = nullptr);
+
+    /**
+     * @brief Decompress a whole file.
+     * @param inputFileName The compressed file.
+     * @param outputFileName The file receiving the uncompressed data.
+     * @param options Decoder and thread settings.
+     * @param stats If not null, receives timings and size figures for the run.
+     * @return False if the file cannot be read or is corrupt.
+     */
+    bool decompress(const std::string& inputFileName, const std::string& outputFileName, const DecompressOptions& options = DecompressOptions(),
+                    RunStats* stats = nullptr);
+
+    /**
+     * @brief Decompress a byte range, decoding only the blocks that cover it.
+     * @param inputFileName The compressed file.
+     * @param outputFileName The file receiving the range.
+     * @param offset Offset of the first byte in the uncompressed data.
+     * @param length Number of bytes to extract (clipped to the end of the data).
+     * @param options Decoder and thread settings.
+     * @param stats If not null, receives timings and size figures for the run.
+     * @return False if the file cannot be read or is corrupt.
+     */
+    bool extract(const std::string& inputFileName, const std::string& outputFileName, uint64_t offset, uint64_t length,
+                 const DecompressOptions& options = DecompressOptions(), RunStats* stats = nullptr);
+
+    /**
+     * @brief Decode a whole file and check every block, without writing the result.
+     *
+     * Blocks are decoded in parallel like decompress, and those written with
+     * a checksum are compared against it.
+     * @param inputFileName The compressed file.
+     * @param options Decoder and thread settings.
+     * @param stats If not null, receives timings and size figures for the run.
+     * @return False, after printing an error naming the first bad block, if the file cannot be read or is corrupt.
+     */
+    bool verify(const std::string& inputFileName, const DecompressOptions& options = DecompressOptions(), RunStats* stats = nullptr);
 }
 
-#endif
\ No newline at end of file
+#endif
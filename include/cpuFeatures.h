@@ -0,0 +1,73 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <string>
+
+/**
+ * @file cpuFeatures.h
+ * @brief Selection of the instruction set used by the hot kernels.
+ *
+ * The histogram, checksum, Huffman encode and Huffman decode kernels are
+ * each written once and compiled for several instruction sets in the same
+ * binary. The best set the processor supports is chosen on first use; it
+ * can be lowered with setCpuLevel, for example to compare the variants.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_FEATURES_X86 1 ///< Defined where kernels for the x86 instruction sets are compiled in
+#endif
+
+#ifdef __GNUC__
+/// Marks a kernel body that is inlined into one entry point per level, each compiled for that level's instructions
+#define CPU_KERNEL inline __attribute__((always_inline))
+#else
+#define CPU_KERNEL inline
+#endif
+
+/**
+ * @brief Instruction sets the kernels are compiled for, from oldest to newest.
+ */
+enum class CpuLevel {
+    Scalar, ///< Portable C++ only
+    Sse42,  ///< SSE4.2: crc32 instruction and 16-byte compares
+    Avx2,   ///< AVX2 with BMI2: 32-byte compares and flag-free variable shifts (shlx, shrx, bzhi)
+};
+
+/**
+ * @brief Newest level the processor supports.
+ * @return The level, found with cpuid once.
+ */
+CpuLevel detectedCpuLevel();
+
+/**
+ * @brief Level the kernels currently use.
+ * @return detectedCpuLevel() unless lowered with setCpuLevel.
+ */
+CpuLevel cpuLevel();
+
+/**
+ * @brief Make the kernels use a level.
+ *
+ * Meant to be called before any work starts; kernels already running
+ * finish with the level they started with.
+ * @param level The level.
+ * @return False, leaving the level unchanged, if the processor does not support it.
+ */
+bool setCpuLevel(CpuLevel level);
+
+/**
+ * @brief Name of a level as accepted by parseCpuLevel.
+ * @param level The level.
+ * @return "scalar", "sse4.2" or "avx2".
+ */
+const char* cpuLevelName(CpuLevel level);
+
+/**
+ * @brief Look up a level by name.
+ * @param name "scalar", "sse4.2" or "avx2".
+ * @param level Receives the level.
+ * @return False if the name is unknown.
+ */
+bool parseCpuLevel(const std::string& name, CpuLevel& level);
+
+#endif // CPU_FEATURES_H
@@ -0,0 +1,62 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include "compressor.h"
+#include "huffman.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @file dictionary.h
+ * @brief Trained Huffman tables shared by many small files.
+ *
+ * A dictionary holds one code length for every byte value, trained on a
+ * sample corpus. Blocks coded with it store no code lengths of their own,
+ * which is most of the compressed size of a file of a few kilobytes.
+ * Dictionary files are laid out as follows:
+ *
+ * | Size | Field                                   |
+ * |------|-----------------------------------------|
+ * | 4    | Magic "HUFT"                            |
+ * | 1    | Dictionary version                      |
+ * | 256  | Code length of byte values 0-255 (1-32) |
+ *
+ * Compressed files record the id of the dictionary they were coded with, a
+ * hash of the code lengths, so decoding with a different one is refused.
+ */
+namespace compressor {
+    extern const char DICTIONARY_MAGIC[4];          ///< Identifies dictionary files
+    extern const unsigned char DICTIONARY_VERSION;  ///< Version of the dictionary layout
+
+    /**
+     * @brief Code table loaded from a dictionary file.
+     */
+    struct Dictionary {
+        uint32_t id = 0;                 ///< Hash of the code lengths, never 0
+        HuffmanCodeTable codes{};        ///< Canonical code for every byte value
+        HuffmanDecodeTable decodeTable;  ///< Decoder for codes, built once
+    };
+
+    /**
+     * @brief Build a dictionary from sample files and save it.
+     *
+     * Byte values are counted over all samples and every value gets a code,
+     * so any input can be coded with the result.
+     * @param samplePath A sample file, or a directory whose regular files are all used.
+     * @param dictionaryFileName The dictionary file to create.
+     * @param maxCodeLength Longest code in bits.
+     * @return False if a sample cannot be read or the dictionary cannot be written.
+     */
+    bool trainDictionary(const std::string& samplePath, const std::string& dictionaryFileName, unsigned maxCodeLength = DEFAULT_MAX_CODE_LENGTH);
+
+    /**
+     * @brief Load a dictionary file.
+     * @param dictionaryFileName The file written by trainDictionary.
+     * @param dictionary Receives the codes and decoder.
+     * @return False, after printing an error, if the file cannot be read or is damaged.
+     */
+    bool loadDictionary(const std::string& dictionaryFileName, Dictionary& dictionary);
+}
+
+#endif // DICTIONARY_H
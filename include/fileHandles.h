@@ -1,20 +1,164 @@
 #ifndef FILE_HANDLES_H
 #define FILE_HANDLES_H
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <map>
 #include <string>
+#include <vector>
 
 namespace fileHandles {
-    //variables for handling data
-    extern std::map<char, unsigned int> frequency_map;
-    extern std::string data;
+    extern const char STANDARD_STREAM[]; ///< Path standing for standard input or standard output
+
+    /**
+     * @brief Number of occurrences of each byte value, indexed by the unsigned byte.
+     */
+    using ByteHistogram = std::array<uint64_t, 256>;
+
+    /**
+     * @brief A read-only run of bytes owned by someone else.
+     */
+    struct ByteSpan {
+        const unsigned char* data = nullptr; ///< First byte
+        size_t size = 0;                     ///< Number of bytes
+    };
+
+    /**
+     * @brief How an InputFile will be read, passed on to the kernel as a madvise hint.
+     */
+    enum class AccessPattern {
+        Sequential, ///< Read front to back once
+        Random      ///< Read selected ranges
+    };
+
+    /**
+     * @brief Read-only input that avoids copying where the operating system allows it.
+     *
+     * Regular files are memory-mapped and handed out as spans into the mapping.
+     * Pipes and other unmappable inputs fall back to large read() calls into a
+     * caller-provided buffer.
+     */
+    class InputFile {
+    public:
+        InputFile() = default;
+        InputFile(const InputFile&) = delete;
+        InputFile& operator=(const InputFile&) = delete;
+
+        /**
+         * @brief Unmap and close the file.
+         */
+        ~InputFile();
+
+        /**
+         * @brief Open a file for reading.
+         * @param path The file to open, or STANDARD_STREAM for standard input.
+         * @param pattern The expected access pattern.
+         * @return False if the file cannot be opened.
+         */
+        bool open(const std::string& path, AccessPattern pattern = AccessPattern::Sequential);
+
+        /**
+         * @brief Check whether the whole file is mapped into memory.
+         * @return True if the file is mapped.
+         */
+        bool isMapped() const;
+
+        /**
+         * @brief Check whether the file supports reads at arbitrary offsets.
+         * @return True for mapped and other regular files.
+         */
+        bool isSeekable() const;
+
+        /**
+         * @brief Get the file size.
+         * @return The size in bytes, or 0 if unknown (pipes).
+         */
+        uint64_t size() const;
+
+        /**
+         * @brief Read the next bytes in sequence.
+         * @param maxBytes Maximum number of bytes to return.
+         * @param buffer Storage used when the file is not mapped.
+         * @return The bytes read; an empty span at end of input.
+         */
+        ByteSpan next(size_t maxBytes, std::vector<unsigned char>& buffer);
+
+        /**
+         * @brief Read bytes at a given offset.
+         *
+         * Safe to call from several threads at once, each with its own buffer.
+         * @param offset Offset of the first byte.
+         * @param length Number of bytes wanted.
+         * @param buffer Storage used when the file is not mapped.
+         * @param out The bytes read.
+         * @return False if the range lies outside the file or cannot be read.
+         */
+        bool readAt(uint64_t offset, size_t length, std::vector<unsigned char>& buffer, ByteSpan& out);
+
+        /**
+         * @brief Page in a span of the mapping, so that the thread working on it does not wait for the disk.
+         *
+         * Does nothing for spans read into a buffer, which are already in memory.
+         * @param span A span returned by next or readAt.
+         */
+        void prefetch(const ByteSpan& span) const;
+
+        /**
+         * @brief Check whether a read failed.
+         * @return True if a read() or pread() call reported an error.
+         */
+        bool failed() const;
+
+    private:
+        int fd = -1;                            ///< File descriptor
+        const unsigned char* mapping = nullptr; ///< Start of the mapping, if mapped
+        uint64_t fileSize = 0;                  ///< Size of a regular file
+        uint64_t position = 0;                  ///< Offset of the next sequential read
+        bool regular = false;                   ///< True for regular files
+        std::atomic<bool> error{false};         ///< Set when a read fails
+    };
+
+    /**
+     * @brief Add the byte counts of a buffer to a histogram.
+     *
+     * Counts into four interleaved 256-entry banks so that runs of equal bytes
+     * do not serialize on one counter; the counting itself is scalar at every
+     * level. At the SSE4.2 and AVX2 levels (see cpuLevel), if a sample of the
+     * buffer shows runs, 16- or 32-byte runs of a single value are detected
+     * with one compare and counted with one add.
+     * @param data Pointer to the bytes.
+     * @param size Number of bytes.
+     * @param histogram Histogram the counts are added to.
+     */
+    void countBytes(const unsigned char* data, size_t size, ByteHistogram& histogram);
+
+    /**
+     * @brief Add the byte counts of a large buffer to a histogram using several threads.
+     *
+     * Each thread counts one slice into its own histogram and the results are
+     * summed. Small buffers are counted on the calling thread.
+     * @param data Pointer to the bytes.
+     * @param size Number of bytes.
+     * @param histogram Histogram the counts are added to.
+     * @param threads Number of threads (0 = one per hardware thread).
+     */
+    void countBytesParallel(const unsigned char* data, size_t size, ByteHistogram& histogram, unsigned threads = 0);
 
     //function prototypes
     bool fileExists(const std::filesystem::path& path);
     std::string correctPath(const std::string& pathStr);
-    void readFileHUF(const std::string& filePath);
+
+    /**
+     * @brief Count the byte values of a whole file.
+     * @param filePath The file to read.
+     * @param histogram Receives the count of each byte value.
+     * @return False if the file cannot be read.
+     */
+    bool readFileHUF(const std::string& filePath, ByteHistogram& histogram);
 };
 
 #endif
@@ -0,0 +1,263 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "compressor.h"
+#include "fileHandles.h"
+#include "huffman.h"
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @file format.h
+ * @brief Pieces of the compressed file layout shared by the file and in-memory code paths.
+ *
+ * See compressor.h for the layout itself.
+ */
+namespace compressor {
+    extern const char INDEX_MAGIC[4];      ///< Identifies the seek index trailer
+    extern const size_t FILE_HEADER_SIZE;  ///< Magic, version, block size and dictionary id
+    extern const size_t BLOCK_HEADER_SIZE; ///< Uncompressed and compressed size fields
+    extern const size_t INDEX_ENTRY_SIZE;  ///< Block offset and uncompressed size
+    extern const size_t TRAILER_SIZE;      ///< Index offset, block count and index magic
+    extern const unsigned char FOUR_STREAMS_FLAG; ///< Set in the mode byte when Huffman payloads are split into four streams
+    extern const size_t JUMP_TABLE_SIZE;   ///< Byte sizes of the first three of four streams
+    extern const unsigned char CHECKSUM_FLAG; ///< Set in the mode byte when the block ends with a checksum
+    extern const size_t CHECKSUM_SIZE;     ///< CRC-32C of the uncompressed block
+
+    /**
+     * @brief How a block is coded; the first byte after the block header.
+     */
+    enum class BlockMode : unsigned char {
+        Table = 0,       ///< The block's own code lengths follow, then the payload
+        Dictionary = 1,  ///< Payload coded with the dictionary's codes
+        Raw = 2,         ///< The bytes themselves, uncoded
+        Run = 3,         ///< One byte value repeated for the whole block; that value follows
+        Repeat = 4,      ///< Codes of an earlier Table block, 4 bytes giving how many blocks back, then the payload
+        Ans = 5,         ///< tANS counts (see ans.h), then the padding byte and bit stream
+        Lz = 6           ///< LZ77 sequences (see lz77.h) in Huffman-coded streams with a table each
+    };
+
+    /**
+     * @brief Get the mode of a block from its mode byte.
+     * @param modeByte The first byte after the block header.
+     * @return The mode, without FOUR_STREAMS_FLAG and CHECKSUM_FLAG.
+     */
+    BlockMode blockMode(unsigned char modeByte);
+
+    /**
+     * @brief Get the name of a block mode as printed in statistics.
+     * @param mode The mode.
+     * @return Lower-case mode name.
+     */
+    const char* blockModeName(BlockMode mode);
+
+    /**
+     * @brief The table a block may reuse: the one most recently stored in the stream.
+     */
+    struct StreamTable {
+        HuffmanCodeTable codes{};  ///< Canonical codes of that table
+        uint64_t block = 0;        ///< Number of the block storing it
+        bool present = false;      ///< False until some block stores a table
+    };
+
+    /**
+     * @brief Passes the table in effect after one block to the next block.
+     *
+     * Lets blocks coded on different threads reuse each other's tables: each
+     * block waits for its predecessor's decision, then publishes its own before
+     * encoding, so only the choice of table is serialised. The table must not
+     * change once published, except by publishing again from the same thread.
+     */
+    class TableLink {
+    public:
+        /**
+         * @brief Set the table and wake a waiting block.
+         * @param table The table in effect after the block.
+         */
+        void publish(const StreamTable& table);
+
+        /**
+         * @brief Wait until the table is published.
+         * @return The published table.
+         */
+        const StreamTable& wait();
+
+    private:
+        StreamTable table;
+        std::mutex tableMutex;
+        std::condition_variable ready;
+        bool published = false;
+    };
+
+    /**
+     * @brief Compress one block, choosing the cheapest of the block modes.
+     *
+     * Byte counts give the exact coded size for every mode before anything is
+     * encoded, so incompressible blocks are stored without being coded, and the
+     * block's own table is only built if it could beat the alternatives.
+     * @param data Pointer to the uncompressed bytes.
+     * @param size Number of uncompressed bytes.
+     * @param out Buffer receiving the compressed block.
+     * @param options Coding settings.
+     * @param blockNumber Number of this block in the stream.
+     * @param previous Table in effect before this block, or null if it may not reuse one.
+     * @param next Receives the table in effect after this block, or null; may be the same link as previous.
+     * @return Size figures and stage times for the block.
+     */
+    BlockStats compressBlock(const unsigned char* data, size_t size, std::vector<unsigned char>& out, const CompressOptions& options,
+                             uint64_t blockNumber, TableLink* previous, TableLink* next);
+
+    /**
+     * @brief Find which earlier block holds the table a block reuses.
+     * @param data Pointer to the block after its header.
+     * @param size Number of compressed bytes.
+     * @param blocksBack Receives how many blocks before this one the table is stored.
+     * @return False if the block does not reuse a table.
+     */
+    bool tableReference(const unsigned char* data, size_t size, uint64_t& blocksBack);
+
+    /**
+     * @brief Largest compressed size a valid block of a given size can have.
+     * @param originalSize Uncompressed bytes in the block.
+     * @return Mode byte, code lengths, a payload of MAX_CODE_LENGTH_LIMIT-bit codes and a checksum.
+     */
+    uint64_t maxCompressedBlockSize(uint64_t originalSize);
+
+    /**
+     * @brief Derive length-limited canonical codes for the byte values present in a histogram.
+     * @param histogram Number of occurrences of each byte value.
+     * @param maxLength Longest code in bits.
+     * @param table Receives the codes.
+     * @return Payload bits plain Huffman codes would have needed.
+     */
+    uint64_t buildCodeTable(const fileHandles::ByteHistogram& histogram, unsigned maxLength, HuffmanCodeTable& table);
+
+    /**
+     * @brief Append a little-endian integer.
+     * @param out Buffer to append to.
+     * @param value The value.
+     * @param bytes Width in bytes.
+     */
+    void writeLittleEndian(std::vector<unsigned char>& out, uint64_t value, unsigned bytes);
+
+    /**
+     * @brief Read a little-endian integer.
+     * @param data Pointer to the first byte.
+     * @param bytes Width in bytes.
+     * @return The value.
+     */
+    uint64_t readLittleEndian(const unsigned char* data, unsigned bytes);
+
+    /**
+     * @brief Append the file header.
+     * @param out Buffer to append to.
+     * @param blockSize Largest uncompressed block.
+     * @param dictionary Dictionary the blocks may be coded with, or null.
+     */
+    void writeFileHeader(std::vector<unsigned char>& out, size_t blockSize, const Dictionary* dictionary);
+
+    /**
+     * @brief Check a file header.
+     * @param data Pointer to at least FILE_HEADER_SIZE bytes.
+     * @param blockSize Receives the largest uncompressed block.
+     * @param dictionaryId Receives the id of the dictionary needed, or 0.
+     * @return False if the magic or version do not match.
+     */
+    bool readFileHeader(const unsigned char* data, uint64_t& blockSize, uint32_t& dictionaryId);
+
+    /**
+     * @brief Check that data coded with a dictionary can be decoded.
+     * @param dictionaryId Id from the file header.
+     * @param dictionary The dictionary supplied for decoding, or null.
+     * @return True if no dictionary is needed or the right one was supplied.
+     */
+    bool dictionaryMatches(uint32_t dictionaryId, const Dictionary* dictionary);
+
+    /**
+     * @brief Append a seek index entry for one block.
+     * @param seekIndex Index being built.
+     * @param fileOffset Offset of the block header in the compressed data.
+     * @param originalSize Uncompressed bytes in the block.
+     */
+    void addIndexEntry(std::vector<unsigned char>& seekIndex, uint64_t fileOffset, uint64_t originalSize);
+
+    /**
+     * @brief Append the end-of-stream marker, the seek index and the trailer.
+     * @param out Buffer to append to.
+     * @param seekIndex Entries added with addIndexEntry.
+     * @param blocksEnd Offset in the compressed data at which the marker starts.
+     */
+    void writeFileEnd(std::vector<unsigned char>& out, const std::vector<unsigned char>& seekIndex, uint64_t blocksEnd);
+
+    /**
+     * @brief Position of one block in the compressed and uncompressed data.
+     */
+    struct BlockIndexEntry {
+        uint64_t fileOffset;      ///< Offset of the block header in the file
+        uint64_t compressedSize;  ///< Code lengths plus payload
+        uint64_t originalSize;    ///< Uncompressed bytes
+        uint64_t originalOffset;  ///< Offset of the block's first byte in the uncompressed data
+    };
+
+    /**
+     * @brief Check the header of a compressed file and load its seek index.
+     * @param infile The open file.
+     * @param inputFileName Name used in error messages.
+     * @param index Receives one entry per block.
+     * @param dictionary The dictionary supplied for decoding, or null.
+     * @return False, after printing an error, if the header or index is damaged or the dictionary does not match.
+     */
+    bool readSeekIndex(fileHandles::InputFile& infile, const std::string& inputFileName, std::vector<BlockIndexEntry>& index,
+                       const Dictionary* dictionary);
+
+    /**
+     * @brief Read the stored table a Repeat block refers to.
+     * @param infile The open file.
+     * @param index Seek index of the stream.
+     * @param block Position of the block in index.
+     * @param data The block after its header.
+     * @param size Compressed bytes of the block.
+     * @param buffer Storage used when the file is not mapped.
+     * @param tableBlock Receives the referenced block after its header; left empty if the block reuses no table.
+     * @return False if the reference points outside the stream or cannot be read.
+     */
+    bool readTableBlock(fileHandles::InputFile& infile, const std::vector<BlockIndexEntry>& index, size_t block, const unsigned char* data,
+                        size_t size, std::vector<unsigned char>& buffer, fileHandles::ByteSpan& tableBlock);
+
+    /**
+     * @brief Load the seek index of a compressed stream stored inside a larger file.
+     * @param infile The open file.
+     * @param inputFileName Name used in error messages.
+     * @param index Receives one entry per block, with file offsets relative to the whole file.
+     * @param dictionary The dictionary supplied for decoding, or null.
+     * @param streamOffset Offset of the stream's header in the file.
+     * @param streamSize Size of the stream, trailer included.
+     * @return False, after printing an error, if the header or index is damaged or the dictionary does not match.
+     */
+    bool readSeekIndex(fileHandles::InputFile& infile, const std::string& inputFileName, std::vector<BlockIndexEntry>& index,
+                       const Dictionary* dictionary, uint64_t streamOffset, uint64_t streamSize);
+
+    /**
+     * @brief Decode one block reusing a decoder table.
+     *
+     * Same as the public decompressBlock, but the table's storage is kept
+     * between calls so repeated decoding does not allocate.
+     * @param data Pointer to the code lengths and payload.
+     * @param size Number of compressed bytes.
+     * @param originalSize Number of uncompressed bytes in the block.
+     * @param out String receiving the decoded bytes.
+     * @param table Decoder table rebuilt for the block.
+     * @param dictionary The dictionary the block may be coded with, or null.
+     * @param tableBlock For Repeat blocks, the block holding the table, after its header.
+     * @param tableBlockSize Bytes available at tableBlock.
+     * @return False if the block is corrupt, its checksum does not match, or it needs a dictionary or table that was not given.
+     */
+    bool decompressBlock(const unsigned char* data, size_t size, size_t originalSize, std::string& out, HuffmanDecodeTable& table,
+                         const Dictionary* dictionary, const unsigned char* tableBlock = nullptr, size_t tableBlockSize = 0);
+}
+
+#endif // FORMAT_H
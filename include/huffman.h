@@ -1,10 +1,43 @@
 #ifndef HUFFMAN_H
 #define HUFFMAN_H
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <functional>
 #include <map>
 #include <fstream>
+#include <string>
+
+/**
+ * @brief Integer Huffman code assigned to one byte value.
+ */
+struct HuffmanCodeEntry {
+    uint64_t code = 0; ///< Code bits, right-aligned; the most significant bit is sent first
+    unsigned char length = 0; ///< Code length in bits (0 if the byte value has no code)
+};
+
+/**
+ * @brief Flat code table indexed by byte value.
+ */
+using HuffmanCodeTable = std::array<HuffmanCodeEntry, 256>;
+
+/**
+ * @brief Longest code the bit writer and the decoders accept.
+ */
+constexpr unsigned MAX_HUFFMAN_CODE_LENGTH = 56;
+
+/**
+ * @brief Assign canonical codes from the code lengths stored in a table.
+ *
+ * Codes of equal length are consecutive in byte-value order and shorter codes
+ * sort before longer ones, so the lengths alone describe the whole code.
+ * @param table The table whose lengths are read and whose codes are written.
+ * @return False if a length exceeds MAX_HUFFMAN_CODE_LENGTH or the lengths do not form a prefix code.
+ */
+bool buildCanonicalCodes(HuffmanCodeTable& table);
 
 // Forward declaration of HuffmanNode
 /**
@@ -141,12 +174,162 @@ public:
     void encode(const std::string& code, std::map<char, std::string>& HuffmanCode);
 
     /**
-     * @brief Decode the Huffman tree.
-     * @param huffmanPtr Pointer to the Huffman tree.
-     * @param infile Input file stream.
-     * @param outfile Output file stream.
+     * @brief Assign integer codes to every leaf below this node.
+     * @param code The code bits accumulated on the path to this node.
+     * @param length The number of bits in code.
+     * @param table The flat table receiving one entry per leaf.
+     */
+    void assignCodes(uint64_t code, unsigned length, HuffmanCodeTable& table);
+
+    /**
+     * @brief Decode a bit stream by walking the tree from this node.
+     * @param data Pointer to the encoded bytes.
+     * @param size Number of encoded bytes.
+     * @param count Number of characters to decode.
+     * @param out String receiving the decoded characters.
+     * @return False if the stream ends early or leads off the tree.
+     */
+    bool decode(const unsigned char* data, size_t size, uint64_t count, std::string& out);
+
+    /**
+     * @brief Build a Huffman tree holding the given codes.
+     * @param codes The code assigned to each byte value.
+     * @return Pointer to the root of the new tree; the caller owns it.
+     */
+    static HuffmanNode* fromCodes(const HuffmanCodeTable& codes);
+};
+
+/**
+ * @brief Number of symbols in one stream of a payload split into four.
+ *
+ * The first three streams hold (count + 3) / 4 consecutive symbols each and
+ * the last one the rest, so every stream but the last is equally long.
+ * @param count Total number of symbols.
+ * @param stream Stream index, 0-3.
+ * @return Symbols in that stream.
+ */
+inline uint64_t interleavedStreamSymbols(uint64_t count, unsigned stream) {
+    uint64_t quarter = (count + 3) / 4;
+    uint64_t begin = std::min<uint64_t>(stream * quarter, count);
+    return std::min<uint64_t>(begin + quarter, count) - begin;
+}
+
+/**
+ * @brief Append data coded with a code table as one bit stream.
+ *
+ * Produces the same bytes as feeding every code to a BitWriter and flushing
+ * it, but writes into space reserved for the longest possible result, with
+ * the kernel compiled for cpuLevel().
+ * @param data Pointer to the bytes.
+ * @param size Number of bytes.
+ * @param codes Codes of at most MAX_HUFFMAN_CODE_LENGTH bits, covering every byte value in data.
+ * @param out Buffer the stream is appended to; the last byte is padded with zeros.
+ */
+void encodeHuffman(const unsigned char* data, size_t size, const HuffmanCodeTable& codes, std::vector<unsigned char>& out);
+
+/**
+ * @brief Table-driven Huffman decoder.
+ *
+ * Peeks PRIMARY_BITS bits at a time from a 64-bit bit buffer and resolves the
+ * symbol and its code length with a single lookup. Codes longer than
+ * PRIMARY_BITS continue into secondary tables of at most SECONDARY_BITS bits.
+ */
+class HuffmanDecodeTable {
+public:
+    static constexpr unsigned PRIMARY_BITS = 11; ///< Bits resolved by the first lookup
+    static constexpr unsigned SECONDARY_BITS = 8; ///< Maximum bits resolved by each secondary lookup
+
+    /**
+     * @brief Build the lookup tables from a code table.
+     * @param codes The code assigned to each byte value.
+     * @return False if the table holds no codes.
+     */
+    bool build(const HuffmanCodeTable& codes);
+
+    /**
+     * @brief Decode a fixed number of symbols from a bit stream.
+     * @param data Pointer to the encoded bytes.
+     * @param size Number of encoded bytes.
+     * @param count Number of symbols to decode.
+     * @param out String receiving the decoded bytes.
+     * @return False if the stream ends early or contains a bit pattern with no code.
+     */
+    bool decode(const unsigned char* data, size_t size, uint64_t count, std::string& out) const;
+
+    /**
+     * @brief Decode four bit streams coded with the same codes in one loop.
+     *
+     * Stream s holds interleavedStreamSymbols(count, s) consecutive symbols.
+     * Decoding the streams side by side breaks the dependency of each lookup
+     * on the previous code's length, so several lookups are in flight at once.
+     * @param streams Pointer to the encoded bytes of each stream.
+     * @param sizes Number of encoded bytes in each stream.
+     * @param count Total number of symbols to decode.
+     * @param out String receiving the decoded bytes, stream 0's first.
+     * @return False if a stream ends early or contains a bit pattern with no code.
+     */
+    bool decodeFour(const unsigned char* const streams[4], const size_t sizes[4], uint64_t count, std::string& out) const;
+
+private:
+    // Entry layout: bits 0-4 bits consumed at this level, bits 5-9 secondary
+    // table width (0 for a symbol), bits 10-31 symbol or secondary table offset.
+    std::vector<uint32_t> entries;
+    std::vector<std::pair<unsigned char, HuffmanCodeEntry>> symbols; ///< Codes present, kept between builds
+    unsigned longestCode = 0; ///< Length of the longest code in bits
+
+    size_t buildLevel(std::vector<std::pair<unsigned char, HuffmanCodeEntry>>& symbols, unsigned consumed, unsigned bits);
+};
+
+/**
+ * @brief Compute optimal code lengths no longer than a limit (package-merge).
+ *
+ * Produces the lengths of the cheapest prefix code whose longest code is at
+ * most maxLength bits. Byte values with a count of 0 get length 0.
+ * @param counts Number of occurrences of each byte value.
+ * @param maxLength The length limit; must satisfy 2^maxLength >= number of used byte values.
+ * @param table The table whose lengths are written (codes are left untouched).
+ * @return False if the limit is too small for the number of used byte values.
+ */
+bool buildLengthLimitedCodeLengths(const std::array<uint64_t, 256>& counts, unsigned maxLength, HuffmanCodeTable& table);
+
+/**
+ * @brief Huffman tree stored in a fixed array of nodes linked by index.
+ *
+ * The leaves are sorted by frequency and merged with the two-queue method:
+ * merged nodes are created in non-decreasing frequency order, so the two
+ * smallest nodes are always at the front of the leaf queue or the merged-node
+ * queue. Construction is linear after the sort and never allocates.
+ */
+class FlatHuffmanTree {
+public:
+    static constexpr unsigned MAX_SYMBOLS = 256;              ///< One leaf per byte value
+    static constexpr unsigned MAX_NODES = 2 * MAX_SYMBOLS - 1; ///< Leaves plus internal nodes
+
+    /**
+     * @brief Build the tree from byte counts.
+     * @param counts Number of occurrences of each byte value.
+     * @return The number of leaves (byte values with a non-zero count).
      */
-    void decode(HuffmanNode* huffmanPtr, std::ifstream& infile, std::ofstream& outfile);
+    unsigned build(const std::array<uint64_t, MAX_SYMBOLS>& counts);
+
+    /**
+     * @brief Store the code length of every byte value in a table.
+     *
+     * Byte values that do not occur get length 0; a lone byte value gets length 1.
+     * @param table The table whose lengths are written (codes are left untouched).
+     */
+    void codeLengths(HuffmanCodeTable& table) const;
+
+private:
+    struct Node {
+        uint64_t frequency;    ///< Combined frequency of the leaves below
+        int16_t parent;        ///< Index of the parent, -1 for the root
+        unsigned char symbol;  ///< Byte value (leaves only)
+    };
+
+    std::array<Node, MAX_NODES> nodes; ///< Leaves first, then internal nodes in creation order
+    unsigned leafCount = 0;            ///< Number of leaves
+    unsigned nodeCount = 0;            ///< Number of nodes in use
 };
 
 class MinHeap {
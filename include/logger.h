@@ -0,0 +1,52 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <ostream>
+
+/**
+ * @namespace logger
+ * @brief Process-wide log level and the stream diagnostic messages are written to.
+ *
+ * Messages go to standard error so they never mix with data written to standard
+ * output. Errors are always reported and are not routed through the logger.
+ */
+namespace logger {
+    /**
+     * @brief How much progress information is printed.
+     */
+    enum class LogLevel {
+        Quiet, ///< Nothing but errors (default)
+        Info,  ///< One line per operation
+        Debug  ///< Internal details such as code tables; slow on large inputs
+    };
+
+    /**
+     * @brief Set the level for the whole process.
+     * @param level The new level.
+     */
+    void setLevel(LogLevel level);
+
+    /**
+     * @brief Get the current level.
+     * @return The level set by setLevel, Quiet by default.
+     */
+    LogLevel level();
+
+    /**
+     * @brief Check whether messages of a level are printed.
+     *
+     * Guard loops that only produce log output with this so they cost nothing when quiet.
+     * @param messageLevel The level of the message.
+     * @return True if the current level includes messageLevel.
+     */
+    bool enabled(LogLevel messageLevel);
+
+    /**
+     * @brief Get the stream for a message.
+     * @param messageLevel The level of the message.
+     * @return Standard error if the level is enabled, otherwise a stream that discards its input.
+     */
+    std::ostream& log(LogLevel messageLevel);
+}
+
+#endif // LOGGER_H
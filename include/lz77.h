@@ -0,0 +1,128 @@
+#ifndef LZ77_H
+#define LZ77_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * @file lz77.h
+ * @brief LZ77 match finding and match copying.
+ *
+ * A block is parsed into sequences, each a run of literal bytes followed by a
+ * copy of earlier output. Matches are found with hash chains over a sliding
+ * window inside the block; higher levels follow longer chains and try lazy
+ * matching, trading speed for smaller output.
+ */
+
+constexpr unsigned LZ_MIN_MATCH = 4;            ///< Shortest match; also the number of bytes hashed
+constexpr uint32_t LZ_WINDOW_SIZE = 1u << 20;   ///< Farthest a match may reach back
+constexpr unsigned LZ_MAX_LEVEL = 9;            ///< Slowest, most thorough level
+constexpr unsigned LZ_VALUE_CODES = 240;        ///< Number of codes used by lzValueCode
+
+/**
+ * @brief Literals followed by one match.
+ */
+struct LzSequence {
+    uint32_t literalLength; ///< Literal bytes before the match
+    uint32_t matchLength;   ///< Bytes copied, at least LZ_MIN_MATCH
+    uint32_t distance;      ///< How far back the copy starts, at least 1
+};
+
+/**
+ * @brief Split a value into a byte-sized code and extra bits.
+ *
+ * Values below 16 are their own code. Larger values are coded by their
+ * highest set bit and the three bits below it, and the remaining low bits
+ * follow as extra bits.
+ * @param value The value.
+ * @param extraBits Receives the number of extra bits.
+ * @return The code, below LZ_VALUE_CODES.
+ */
+inline unsigned lzValueCode(uint32_t value, unsigned& extraBits) {
+    if (value < 16) {
+        extraBits = 0;
+        return value;
+    }
+    unsigned high = 31 - static_cast<unsigned>(__builtin_clz(value));
+    extraBits = high - 3;
+    return 16 + (high - 4) * 8 + ((value >> extraBits) & 7);
+}
+
+/**
+ * @brief Smallest value of a code from lzValueCode.
+ * @param code The code; must be below LZ_VALUE_CODES.
+ * @param extraBits Receives the number of extra bits to add to the result.
+ * @return The value with all extra bits zero.
+ */
+inline uint32_t lzValueBase(unsigned code, unsigned& extraBits) {
+    if (code < 16) {
+        extraBits = 0;
+        return code;
+    }
+    extraBits = (code - 16) / 8 + 1;
+    return uint32_t(8 | ((code - 16) & 7)) << extraBits;
+}
+
+/**
+ * @brief Copy a match, which may overlap its own output.
+ *
+ * Copies eight bytes at a time when the source is at least that far back
+ * and the buffer has room for the last copy to run over.
+ * @param dest Where the match starts.
+ * @param distance How far back the source starts; at least 1.
+ * @param length Number of bytes.
+ * @param end End of the output buffer.
+ */
+inline void lzCopyMatch(unsigned char* dest, size_t distance, size_t length, const unsigned char* end) {
+    const unsigned char* src = dest - distance;
+    unsigned char* stop = dest + length;
+    if (distance == 1) {
+        memset(dest, *src, length); // A run of one byte value
+        return;
+    }
+    if (distance >= 8) {
+        while (dest + 8 <= stop || (dest < stop && end - dest >= 8)) {
+            memcpy(dest, src, 8);
+            dest += 8;
+            src += 8;
+        }
+    }
+    while (dest < stop) { // Short periods, and the tail at the very end of the buffer
+        *dest++ = *src++;
+    }
+}
+
+/**
+ * @brief Hash-chain match finder.
+ *
+ * Keeps its tables between calls, so one finder per thread parses any
+ * number of blocks without allocating once the tables have grown.
+ */
+class LzMatchFinder {
+public:
+    /**
+     * @brief Parse a block into sequences and the literal bytes they use.
+     * @param data Pointer to the block.
+     * @param size Number of bytes.
+     * @param level Search effort, 1 to LZ_MAX_LEVEL.
+     * @param sequences Receives the sequences, replacing its contents.
+     * @param literals Receives every literal byte, in order, including those after the last match.
+     */
+    void parse(const unsigned char* data, size_t size, unsigned level, std::vector<LzSequence>& sequences, std::vector<unsigned char>& literals);
+
+private:
+    static constexpr unsigned HASH_BITS = 16;
+
+    /// Longest match for position pos, searching at most depth earlier positions with the same hash
+    uint32_t findMatch(const unsigned char* data, size_t size, size_t pos, unsigned depth, uint32_t nice, uint32_t& distance) const;
+
+    /// Add position pos to the chain of its hash
+    void insert(const unsigned char* data, size_t pos);
+
+    std::vector<uint32_t> head;   ///< Latest position + 1 for each hash, 0 if none
+    std::vector<uint32_t> chain;  ///< Previous position + 1 with the same hash, indexed by position within the window
+};
+
+#endif // LZ77_H
@@ -0,0 +1,132 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace compressor {
+    /**
+     * @brief Pipeline stages timed for --stats.
+     */
+    enum class Stage {
+        Read,       ///< Fetching input blocks from the file or mapping
+        Histogram,  ///< Counting byte values
+        Build,      ///< Building the Huffman code table
+        Encode,     ///< Writing code lengths and the bit-packed payload
+        Decode,     ///< Decoding compressed blocks
+        Write,      ///< Writing output
+        Count       ///< Number of stages
+    };
+
+    /**
+     * @brief Get the name of a stage as printed in statistics.
+     * @param stage The stage.
+     * @return Lower-case stage name.
+     */
+    const char* stageName(Stage stage);
+
+    /**
+     * @brief Wall-clock and CPU time spent in one stage.
+     */
+    struct StageTime {
+        double wallSeconds = 0; ///< Elapsed time
+        double cpuSeconds = 0;  ///< CPU time of the thread doing the work
+    };
+
+    /// Time per stage, indexed by Stage.
+    using StageTimes = std::array<StageTime, static_cast<size_t>(Stage::Count)>;
+
+    /**
+     * @brief Figures reported for one block.
+     */
+    struct BlockStats {
+        uint64_t originalSize = 0;          ///< Uncompressed bytes
+        uint64_t compressedSize = 0;        ///< Compressed bytes, block header included
+        uint64_t payloadBits = 0;           ///< Coded payload bits with the code length limit
+        uint64_t unboundedPayloadBits = 0;  ///< Coded payload bits plain Huffman codes would need
+        const char* mode = "";              ///< How the block was coded (compress only)
+        StageTimes times;                   ///< Time spent on the block in each stage
+    };
+
+    /**
+     * @brief Figures for a whole compress, decompress or extract run.
+     *
+     * Stage times are summed over blocks, so with several threads the histogram,
+     * build, encode and decode times can exceed the total wall time.
+     */
+    struct RunStats {
+        std::string operation;          ///< "compress", "decompress" or "extract"
+        uint64_t bytesIn = 0;           ///< Bytes read from the input file
+        uint64_t bytesOut = 0;          ///< Bytes written to the output file
+        double ratio = 0;               ///< Uncompressed size over compressed size
+        double wallSeconds = 0;         ///< Elapsed time of the whole run
+        double cpuSeconds = 0;          ///< CPU time of all threads during the run
+        uint64_t peakResidentBytes = 0; ///< Peak resident set size of the process
+        StageTimes stages;              ///< Time per stage
+        std::vector<BlockStats> blocks; ///< Per-block figures in file order
+    };
+
+    /**
+     * @brief Measures wall-clock and calling-thread CPU time between checkpoints.
+     */
+    class StageTimer {
+    public:
+        /**
+         * @brief Start timing.
+         */
+        StageTimer();
+
+        /**
+         * @brief Add the time since the last checkpoint to a stage and start the next interval.
+         * @param times The stage times to update.
+         * @param stage The stage the interval belongs to.
+         */
+        void stop(StageTimes& times, Stage stage);
+
+    private:
+        std::chrono::steady_clock::time_point wallStart; ///< Start of the current interval
+        double cpuStart;                                 ///< Thread CPU time at the start of the interval
+    };
+
+    /**
+     * @brief Get the CPU time used by the calling thread.
+     * @return Seconds of user and system time.
+     */
+    double threadCpuSeconds();
+
+    /**
+     * @brief Get the CPU time used by all threads of the process.
+     * @return Seconds of user and system time.
+     */
+    double processCpuSeconds();
+
+    /**
+     * @brief Get the peak resident set size of the process.
+     * @return Bytes, or 0 if the operating system does not report it.
+     */
+    uint64_t peakResidentBytes();
+
+    /**
+     * @brief Add one set of stage times to another.
+     * @param total The times to add to.
+     * @param times The times to add.
+     */
+    void addStageTimes(StageTimes& total, const StageTimes& times);
+
+    /**
+     * @brief Print run statistics.
+     *
+     * Only stages that took time are listed.
+     * @param stats The statistics to print.
+     * @param json True for a single-line JSON object, false for a readable table.
+     * @param out The stream to print to.
+     */
+    void printStats(const RunStats& stats, bool json, std::ostream& out);
+}
+
+#endif // STATS_H
@@ -0,0 +1,76 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Fixed-size pool of worker threads running queued tasks in submission order.
+ */
+class ThreadPool {
+public:
+    static constexpr unsigned MAX_THREADS = 1024; ///< Largest thread count resolveThreadCount returns
+
+    /**
+     * @brief Start the worker threads.
+     * @param threads Number of workers (at least one is started).
+     */
+    explicit ThreadPool(unsigned threads);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Finish the queued tasks and join the workers.
+     */
+    ~ThreadPool();
+
+    /**
+     * @brief Queue a task.
+     * @param task Callable taking no arguments.
+     * @return Future receiving the task's result.
+     */
+    template <typename Task>
+    std::future<typename std::invoke_result<Task>::type> submit(Task task) {
+        using Result = typename std::invoke_result<Task>::type;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace_back([packaged]() { (*packaged)(); });
+        }
+        available.notify_one();
+        return result;
+    }
+
+    /**
+     * @brief Get the number of worker threads.
+     * @return The number of workers.
+     */
+    unsigned size() const;
+
+    /**
+     * @brief Resolve a requested thread count.
+     * @param requested Requested number of threads, 0 meaning one per hardware thread.
+     * @return The number of threads to use, from one to MAX_THREADS.
+     */
+    static unsigned resolveThreadCount(unsigned requested);
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;          ///< Worker threads
+    std::deque<std::function<void()>> tasks;   ///< Tasks waiting for a worker
+    std::mutex mutex;                          ///< Guards tasks and stopping
+    std::condition_variable available;         ///< Signalled when a task is queued or the pool stops
+    bool stopping = false;                     ///< Set when the pool is shutting down
+};
+
+#endif // THREAD_POOL_H
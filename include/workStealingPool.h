@@ -0,0 +1,82 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Pool of worker threads that balance uneven work by stealing tasks from each other.
+ *
+ * Each worker owns a task deque. Tasks submitted by a worker go to the back of
+ * its own deque and are taken back newest first, while cache-warm; tasks
+ * submitted from other threads are dealt round robin. A worker whose deque is
+ * empty steals the oldest task of another worker, so a mix of long and short
+ * tasks keeps every thread busy without a central queue becoming a bottleneck.
+ */
+class WorkStealingPool {
+public:
+    /**
+     * @brief Start the worker threads.
+     * @param threads Number of workers (at least one is started).
+     */
+    explicit WorkStealingPool(unsigned threads);
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * @brief Finish all queued tasks and join the workers.
+     */
+    ~WorkStealingPool();
+
+    /**
+     * @brief Queue a task.
+     *
+     * May be called from inside a task to split work further.
+     * @param task Callable taking no arguments.
+     * @return Future receiving the task's result.
+     */
+    template <typename Task>
+    std::future<typename std::invoke_result<Task>::type> submit(Task task) {
+        using Result = typename std::invoke_result<Task>::type;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> result = packaged->get_future();
+        enqueue([packaged]() { (*packaged)(); });
+        return result;
+    }
+
+    /**
+     * @brief Get the number of worker threads.
+     * @return The number of workers.
+     */
+    unsigned size() const;
+
+private:
+    /// One worker's tasks; the owner uses the back, thieves the front
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void enqueue(std::function<void()> task);
+    bool takeTask(unsigned self, std::function<void()>& task);
+    void workerLoop(unsigned self);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues; ///< One per worker
+    std::vector<std::thread> workers;               ///< Worker threads
+    std::atomic<size_t> queued{0};                  ///< Tasks waiting in any queue
+    std::atomic<unsigned> nextQueue{0};             ///< Round-robin target for outside submissions
+    std::mutex sleepMutex;                          ///< Guards sleeping and stopping
+    std::condition_variable available;              ///< Signalled when a task is queued or the pool stops
+    bool stopping = false;                          ///< Set when the pool is shutting down
+};
+
+#endif // WORK_STEALING_POOL_H
@@ -0,0 +1,263 @@
+/**
+ * @file ans.cpp
+ * @brief tANS count scaling, table construction, encoder and decoder.
+ */
+#include "ans.h"
+#include "bitstream.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+    // Index of the highest set bit of a nonzero value
+    unsigned highBit(uint32_t value) {
+        return 31 - static_cast<unsigned>(__builtin_clz(value));
+    }
+
+    // Scatters each byte value over its slots with a fixed odd step, so the states of one value are spread across the table
+    void spreadSymbols(const AnsCounts& normalized, array<unsigned char, 1 << ANS_MAX_TABLE_LOG>& spread) {
+        uint32_t tableSize = 1u << normalized.tableLog;
+        uint32_t mask = tableSize - 1;
+        uint32_t step = (tableSize >> 1) + (tableSize >> 3) + 3;
+        uint32_t position = 0;
+        for (unsigned symbol = 0; symbol < 256; ++symbol) {
+            for (uint32_t i = 0; i < normalized.counts[symbol]; ++i) {
+                spread[position] = static_cast<unsigned char>(symbol);
+                position = (position + step) & mask;
+            }
+        }
+    }
+}
+
+// Largest-remainder rounding to the table size, then slots taken back from the biggest counts
+// if giving rare values their one slot overfilled the table
+void normalizeAnsCounts(const array<uint64_t, 256>& histogram, uint64_t total, AnsCounts& normalized) {
+    normalized.tableLog = ANS_MIN_TABLE_LOG;
+    while (normalized.tableLog < ANS_MAX_TABLE_LOG && (uint64_t(1) << normalized.tableLog) < total) {
+        ++normalized.tableLog;
+    }
+    uint32_t tableSize = 1u << normalized.tableLog;
+
+    array<double, 256> remainders{};
+    array<unsigned char, 256> order;
+    unsigned symbols = 0;
+    uint32_t assigned = 0;
+    for (unsigned symbol = 0; symbol < 256; ++symbol) {
+        normalized.counts[symbol] = 0;
+        if (histogram[symbol] == 0) {
+            continue;
+        }
+        double exact = static_cast<double>(histogram[symbol]) * tableSize / total;
+        uint32_t count = max<uint32_t>(1, static_cast<uint32_t>(exact));
+        normalized.counts[symbol] = static_cast<uint16_t>(count);
+        remainders[symbol] = exact - count;
+        assigned += count;
+        order[symbols++] = static_cast<unsigned char>(symbol);
+    }
+
+    if (assigned < tableSize) {
+        sort(order.begin(), order.begin() + symbols, [&](unsigned char a, unsigned char b) {
+            return remainders[a] != remainders[b] ? remainders[a] > remainders[b] : a < b;
+        });
+        for (unsigned i = 0; assigned < tableSize; i = (i + 1) % symbols, ++assigned) {
+            ++normalized.counts[order[i]];
+        }
+    }
+    if (assigned > tableSize) {
+        sort(order.begin(), order.begin() + symbols, [&](unsigned char a, unsigned char b) {
+            return normalized.counts[a] != normalized.counts[b] ? normalized.counts[a] > normalized.counts[b] : a < b;
+        });
+        while (assigned > tableSize) {
+            for (unsigned i = 0; i < symbols && assigned > tableSize && normalized.counts[order[i]] > 1; ++i, --assigned) {
+                --normalized.counts[order[i]];
+            }
+        }
+    }
+}
+
+uint64_t ansCodedBits(const array<uint64_t, 256>& histogram, const AnsCounts& normalized) {
+    double bits = 0;
+    for (unsigned symbol = 0; symbol < 256; ++symbol) {
+        if (histogram[symbol] > 0) {
+            bits += histogram[symbol] * (normalized.tableLog - log2(static_cast<double>(normalized.counts[symbol])));
+        }
+    }
+    return static_cast<uint64_t>(ceil(bits));
+}
+
+void writeAnsCounts(const AnsCounts& normalized, vector<unsigned char>& out) {
+    out.push_back(static_cast<unsigned char>(normalized.tableLog));
+    unsigned symbol = 0;
+    while (symbol < 256) {
+        uint32_t count = normalized.counts[symbol];
+        if (count > 64) {
+            out.push_back(static_cast<unsigned char>(0x40 | ((count - 65) >> 8)));
+            out.push_back(static_cast<unsigned char>(count - 65));
+            ++symbol;
+        } else if (count > 0) {
+            out.push_back(static_cast<unsigned char>(count - 1));
+            ++symbol;
+        } else {
+            unsigned run = 0;
+            while (symbol < 256 && normalized.counts[symbol] == 0 && run < 128) {
+                ++run;
+                ++symbol;
+            }
+            out.push_back(static_cast<unsigned char>(0x80 | (run - 1)));
+        }
+    }
+}
+
+size_t readAnsCounts(const unsigned char* data, size_t size, AnsCounts& normalized) {
+    if (size == 0 || data[0] < ANS_MIN_TABLE_LOG || data[0] > ANS_MAX_TABLE_LOG) {
+        return 0;
+    }
+    normalized.tableLog = data[0];
+    normalized.counts.fill(0);
+    size_t pos = 1;
+    unsigned symbol = 0;
+    uint32_t total = 0;
+    while (symbol < 256 && pos < size) {
+        unsigned char value = data[pos++];
+        if (value & 0x80) {
+            symbol += (value & 0x7F) + 1; // Run of absent byte values
+            continue;
+        }
+        uint32_t count = value + 1;
+        if (value & 0x40) {
+            if (pos == size) {
+                return 0;
+            }
+            count = (uint32_t(value & 0x3F) << 8 | data[pos++]) + 65;
+        }
+        total += count;
+        if (total > (1u << normalized.tableLog)) {
+            return 0;
+        }
+        normalized.counts[symbol++] = static_cast<uint16_t>(count);
+    }
+    return symbol == 256 && total == (1u << normalized.tableLog) ? pos : 0;
+}
+
+// For each byte value, lists the states that emit it in slot order, and precomputes how many bits
+// a state gives up before moving to one of them
+void AnsEncoder::build(const AnsCounts& normalized) {
+    tableLog = normalized.tableLog;
+    uint32_t tableSize = 1u << tableLog;
+    array<unsigned char, 1 << ANS_MAX_TABLE_LOG> spread;
+    spreadSymbols(normalized, spread);
+
+    array<uint32_t, 256> next;
+    uint32_t cumulative = 0;
+    for (unsigned symbol = 0; symbol < 256; ++symbol) {
+        uint32_t count = normalized.counts[symbol];
+        next[symbol] = cumulative;
+        if (count == 1) {
+            transforms[symbol].deltaBits = static_cast<int32_t>((tableLog << 16) - tableSize);
+        } else if (count > 1) {
+            unsigned maxBits = tableLog - highBit(count - 1);
+            transforms[symbol].deltaBits = static_cast<int32_t>((maxBits << 16) - (count << maxBits));
+        }
+        transforms[symbol].deltaState = static_cast<int32_t>(cumulative) - static_cast<int32_t>(count);
+        cumulative += count;
+    }
+    for (uint32_t slot = 0; slot < tableSize; ++slot) {
+        nextStates[next[spread[slot]]++] = static_cast<uint16_t>(tableSize + slot);
+    }
+}
+
+// Codes the input last byte first, prepending each state's low bits so the decoder reads them front to back.
+// Bits collect in an accumulator whose lowest bit is the last one in the stream; full words are stored
+// backwards from the end of the reserved space, which is then moved into place.
+void AnsEncoder::encode(const unsigned char* data, size_t size, vector<unsigned char>& out) const {
+    size_t start = out.size();
+    size_t bound = (uint64_t(size) * tableLog + tableLog + 7) / 8 + 8;
+    out.resize(start + bound);
+    unsigned char* end = out.data() + out.size();
+    unsigned char* pos = end;
+
+    uint32_t tableSize = 1u << tableLog;
+    uint32_t state = tableSize;
+    uint64_t accumulator = 0;
+    unsigned bitCount = 0;
+    for (size_t i = size; i-- > 0;) {
+        const Transform& transform = transforms[data[i]];
+        unsigned bits = (state + static_cast<uint32_t>(transform.deltaBits)) >> 16;
+        accumulator |= uint64_t(state & ((1u << bits) - 1)) << bitCount;
+        bitCount += bits;
+        state = nextStates[(state >> bits) + transform.deltaState];
+        if (bitCount >= 32) {
+            pos -= 4;
+            pos[0] = static_cast<unsigned char>(accumulator >> 24);
+            pos[1] = static_cast<unsigned char>(accumulator >> 16);
+            pos[2] = static_cast<unsigned char>(accumulator >> 8);
+            pos[3] = static_cast<unsigned char>(accumulator);
+            accumulator >>= 32;
+            bitCount -= 32;
+        }
+    }
+
+    // The final state comes first in the stream, then zero bits pad the front to a whole byte
+    accumulator |= uint64_t(state - tableSize) << bitCount;
+    bitCount += tableLog;
+    while (bitCount >= 8) {
+        *--pos = static_cast<unsigned char>(accumulator);
+        accumulator >>= 8;
+        bitCount -= 8;
+    }
+    unsigned padding = 0;
+    if (bitCount > 0) {
+        *--pos = static_cast<unsigned char>(accumulator);
+        padding = 8 - bitCount;
+    }
+    *--pos = static_cast<unsigned char>(padding);
+
+    size_t length = static_cast<size_t>(end - pos);
+    memmove(out.data() + start, pos, length);
+    out.resize(start + length);
+}
+
+// Each slot decodes to its byte value and the range of states the encoder came from
+void AnsDecodeTable::build(const AnsCounts& normalized) {
+    tableLog = normalized.tableLog;
+    uint32_t tableSize = 1u << tableLog;
+    array<unsigned char, 1 << ANS_MAX_TABLE_LOG> spread;
+    spreadSymbols(normalized, spread);
+
+    array<uint32_t, 256> next;
+    for (unsigned symbol = 0; symbol < 256; ++symbol) {
+        next[symbol] = normalized.counts[symbol];
+    }
+    for (uint32_t slot = 0; slot < tableSize; ++slot) {
+        unsigned char symbol = spread[slot];
+        uint32_t state = next[symbol]++;
+        unsigned bits = tableLog - highBit(state);
+        uint32_t base = (state << bits) - tableSize;
+        entries[slot] = symbol | (bits << 8) | (base << 16);
+    }
+}
+
+bool AnsDecodeTable::decode(const unsigned char* data, size_t size, uint64_t count, string& out) const {
+    if (size == 0 || data[0] > 7) {
+        return false;
+    }
+    unsigned padding = data[0];
+    ++data;
+    --size;
+
+    BitReader reader(data, size);
+    reader.read(padding);
+    uint32_t state = static_cast<uint32_t>(reader.read(tableLog));
+
+    size_t first = out.size();
+    out.resize(first + count);
+    char* dest = &out[0] + first;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint32_t entry = entries[state];
+        dest[i] = static_cast<char>(entry);
+        state = (entry >> 16) + static_cast<uint32_t>(reader.read((entry >> 8) & 0xFF));
+    }
+    return !reader.overrun();
+}
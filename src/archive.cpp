@@ -0,0 +1,515 @@
+/**
+ * @file archive.cpp
+ * @brief Parallel creation and extraction of multi-file archives.
+ */
+#include "archive.h"
+#include "fileHandles.h"
+#include "format.h"
+#include "logger.h"
+#include "threadPool.h"
+#include "workStealingPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace fileHandles;
+using logger::LogLevel;
+namespace fs = std::filesystem;
+
+namespace compressor {
+    const char ARCHIVE_MAGIC[4] = {'H', 'U', 'F', 'A'};
+    const unsigned char ARCHIVE_VERSION = 2;  // Version 2 added directory entries; version 1 archives are still read
+    const char ARCHIVE_INDEX_MAGIC[4] = {'H', 'U', 'F', 'D'};
+    const size_t ARCHIVE_HEADER_SIZE = 5;      // Magic and version
+    const size_t ARCHIVE_TRAILER_SIZE = 16;    // Index offset, member count and index magic
+    const size_t MAX_ARCHIVE_PATH = 0xFFFF;    // Longest path the index can hold
+    const size_t JOBS_PER_THREAD = 64;         // Small files in flight per thread; they are cheap to hold
+
+    namespace {
+        // A file found below the archived directory
+        struct ArchiveFile {
+            string name;         // Path inside the archive
+            fs::path source;     // Path on disk
+            uint64_t size;       // Size when listed
+        };
+
+        // One task: a whole small file, opened and read by the worker, or one block of a large file
+        struct ArchiveJob {
+            size_t file = 0;                    // Index into the file list
+            shared_ptr<InputFile> source;       // Large file the block belongs to, kept open while queued
+            ByteSpan input;                     // Block of a large file
+            vector<unsigned char> buffer;       // Storage for input that is not memory-mapped
+            vector<unsigned char> output;       // Compressed blocks, back to back
+            vector<uint64_t> blockSizes;        // Uncompressed size of each block in output
+            uint64_t inputSize = 0;             // Bytes counted against the in-flight limit
+            bool readable = true;               // False if the file could not be read
+        };
+
+        // One entry of the central index
+        struct ArchiveMember {
+            string name;
+            uint64_t offset = 0;
+            uint64_t size = 0;
+            uint64_t originalSize = 0;
+        };
+
+        // Closes the descriptor once the last block sharing it is written
+        struct OutputDescriptor {
+            int fd = -1;
+            ~OutputDescriptor() {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+        };
+
+        // Lists regular files below root in path order, leaving out the archive itself, and every directory below root
+        // as its path with a trailing '/', so that empty ones are recreated on extraction. Symbolic links are skipped,
+        // whatever they point to, rather than stored as copies of their targets
+        bool listFiles(const fs::path& root, const fs::path& exclude, vector<ArchiveFile>& files, vector<string>& directories) {
+            error_code error;
+            fs::path excluded = fs::weakly_canonical(exclude, error);
+            for (fs::recursive_directory_iterator it(root, error), end; it != end; it.increment(error)) {
+                if (error) {
+                    break;
+                }
+                if (it->is_symlink(error)) {
+                    continue;
+                }
+                if (it->is_directory(error)) {
+                    string name = it->path().lexically_relative(root).generic_string() + "/";
+                    if (name.size() > MAX_ARCHIVE_PATH) {
+                        cerr << "Path too long for the archive: " << it->path() << endl;
+                        return false;
+                    }
+                    directories.push_back(name);
+                    continue;
+                }
+                if (!it->is_regular_file(error) || fs::weakly_canonical(it->path(), error) == excluded) {
+                    continue;
+                }
+                string name = it->path().lexically_relative(root).generic_string();
+                if (name.size() > MAX_ARCHIVE_PATH) {
+                    cerr << "Path too long for the archive: " << it->path() << endl;
+                    return false;
+                }
+                files.push_back({name, it->path(), it->file_size(error)});
+            }
+            if (error) {
+                cerr << "Cannot list directory: " << root << " (" << error.message() << ")" << endl;
+                return false;
+            }
+            sort(files.begin(), files.end(), [](const ArchiveFile& a, const ArchiveFile& b) { return a.name < b.name; });
+            return true;
+        }
+
+        // Compresses every block of data into job->output
+        void compressBlocks(ArchiveJob& job, ByteSpan data, size_t blockSize, const CompressOptions& options) {
+            TableLink tables; // Blocks of one job may reuse each other's tables
+            tables.publish(StreamTable());
+            for (size_t pos = 0; pos < data.size; pos += blockSize) {
+                size_t length = min(blockSize, data.size - pos);
+                compressBlock(data.data + pos, length, job.output, options, job.blockSizes.size(), &tables, &tables);
+                job.blockSizes.push_back(length);
+            }
+        }
+
+        // Rejects absolute paths and paths that climb out of the output directory
+        bool isSafeMemberName(const string& name) {
+            fs::path path(name);
+            if (name.empty() || path.is_absolute() || path.has_root_name() || path.has_root_directory()) {
+                return false;
+            }
+            for (const fs::path& part : path) {
+                if (part == "..") {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // pwrite() that retries short writes
+        bool writeAt(int fd, const char* data, size_t size, uint64_t offset) {
+            while (size > 0) {
+                ssize_t count = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count <= 0) {
+                    return false;
+                }
+                data += count;
+                size -= static_cast<size_t>(count);
+                offset += static_cast<uint64_t>(count);
+            }
+            return true;
+        }
+    }
+
+    bool archive(const std::string& inputDirectory, const std::string& archiveFileName, const CompressOptions& options) {
+        vector<ArchiveFile> files;
+        vector<string> directories;
+        if (!listFiles(inputDirectory, archiveFileName, files, directories)) {
+            return false;
+        }
+        ofstream outFile(archiveFileName, ios::binary);
+        if (!outFile) {
+            cerr << "Cannot create file: " << archiveFileName << endl;
+            return false;
+        }
+
+        size_t blockSize = min(max(options.blockSize, MIN_BLOCK_SIZE), MAX_BLOCK_SIZE);
+        unsigned threads = ThreadPool::resolveThreadCount(options.threads);
+        WorkStealingPool pool(threads);
+
+        vector<unsigned char> outBuffer(ARCHIVE_MAGIC, ARCHIVE_MAGIC + sizeof(ARCHIVE_MAGIC));
+        outBuffer.push_back(ARCHIVE_VERSION);
+        outFile.write(reinterpret_cast<const char*>(outBuffer.data()), outBuffer.size());
+        uint64_t fileOffset = outBuffer.size();
+
+        // Members are written in file order as their jobs finish. Jobs in flight are
+        // bounded by count and by input bytes, so memory stays a few blocks per thread.
+        deque<pair<shared_ptr<ArchiveJob>, future<void>>> pending;
+        uint64_t pendingBytes = 0;
+        size_t maxPending = JOBS_PER_THREAD * static_cast<size_t>(threads);
+        uint64_t maxPendingBytes = 4 * static_cast<uint64_t>(threads) * blockSize;
+
+        vector<ArchiveMember> members;
+        vector<unsigned char> seekIndex;           // Index of the member being written
+        size_t currentFile = files.size();         // File of the member being written
+        uint64_t totalIn = 0;
+        bool intact = true;
+
+        auto finishMember = [&]() {
+            if (currentFile == files.size()) {
+                return;
+            }
+            ArchiveMember& member = members.back();
+            outBuffer.clear();
+            writeFileEnd(outBuffer, seekIndex, fileOffset - member.offset);
+            outFile.write(reinterpret_cast<const char*>(outBuffer.data()), outBuffer.size());
+            fileOffset += outBuffer.size();
+            member.size = fileOffset - member.offset;
+            totalIn += member.originalSize;
+        };
+        auto writeJob = [&](const shared_ptr<ArchiveJob>& job) {
+            if (job->file != currentFile) {
+                finishMember();
+                currentFile = job->file;
+                members.push_back({files[currentFile].name, fileOffset, 0, 0});
+                seekIndex.clear();
+                outBuffer.clear();
+                writeFileHeader(outBuffer, blockSize, options.dictionary.get());
+                outFile.write(reinterpret_cast<const char*>(outBuffer.data()), outBuffer.size());
+                fileOffset += outBuffer.size();
+            }
+            ArchiveMember& member = members.back();
+            size_t pos = 0;
+            for (uint64_t originalSize : job->blockSizes) {
+                size_t compressedSize = BLOCK_HEADER_SIZE + readLittleEndian(job->output.data() + pos + 4, 4);
+                addIndexEntry(seekIndex, fileOffset + pos - member.offset, originalSize);
+                member.originalSize += originalSize;
+                pos += compressedSize;
+            }
+            outFile.write(reinterpret_cast<const char*>(job->output.data()), job->output.size());
+            fileOffset += job->output.size();
+        };
+        auto writeOldest = [&]() {
+            shared_ptr<ArchiveJob> job = pending.front().first;
+            pending.front().second.get();
+            pending.pop_front();
+            pendingBytes -= job->inputSize;
+            if (!job->readable) {
+                cerr << "Cannot read file: " << files[job->file].source << endl;
+                intact = false;
+            } else if (intact) {
+                writeJob(job);
+            }
+        };
+
+        shared_ptr<InputFile> largeFile;   // Large file whose blocks are being handed out
+        size_t largeIndex = 0;             // Its index in the file list
+        bool largeStarted = false;         // At least one of its blocks has been queued
+        size_t nextFile = 0;
+        for (;;) {
+            while (intact && pending.size() < maxPending && (pending.empty() || pendingBytes < maxPendingBytes)) {
+                shared_ptr<ArchiveJob> job = make_shared<ArchiveJob>();
+                if (largeFile) {
+                    job->file = largeIndex;
+                    job->source = largeFile;
+                    job->input = largeFile->next(blockSize, job->buffer);
+                    if (job->input.size == 0 && (largeStarted || largeFile->failed())) {
+                        if (largeFile->failed()) {
+                            cerr << "Error reading file: " << files[largeIndex].source << endl;
+                            intact = false;
+                        }
+                        largeFile.reset();
+                        continue;
+                    }
+                    largeStarted = true;
+                    job->inputSize = job->input.size;
+                    pending.emplace_back(job, pool.submit([job, &options, blockSize]() {
+                        compressBlocks(*job, job->input, blockSize, options);
+                    }));
+                    pendingBytes += job->inputSize;
+                } else if (nextFile < files.size()) {
+                    if (files[nextFile].size > blockSize) {
+                        largeFile = make_shared<InputFile>();
+                        largeIndex = nextFile++;
+                        largeStarted = false;
+                        if (!largeFile->open(files[largeIndex].source.string(), AccessPattern::Sequential)) {
+                            cerr << "Cannot open file: " << files[largeIndex].source << endl;
+                            intact = false;
+                        }
+                        continue;
+                    }
+                    job->file = nextFile++;
+                    job->inputSize = files[job->file].size;
+                    string path = files[job->file].source.string();
+                    pending.emplace_back(job, pool.submit([job, path, &options, blockSize]() {
+                        InputFile file;
+                        if (!file.open(path, AccessPattern::Sequential)) {
+                            job->readable = false;
+                            return;
+                        }
+                        for (ByteSpan span = file.next(blockSize, job->buffer); span.size > 0; span = file.next(blockSize, job->buffer)) {
+                            compressBlocks(*job, span, blockSize, options); // The file may have grown since it was listed
+                        }
+                        job->readable = !file.failed();
+                    }));
+                    pendingBytes += job->inputSize;
+                } else {
+                    break;
+                }
+            }
+            if (pending.empty()) {
+                break;
+            }
+            writeOldest();
+        }
+        if (!intact) {
+            return false;
+        }
+        finishMember();
+
+        // Central index and trailer; directories have no stream, so their offset and sizes are 0
+        uint64_t indexOffset = fileOffset;
+        size_t fileCount = members.size();
+        for (const string& directory : directories) {
+            members.push_back({directory, 0, 0, 0});
+        }
+        sort(members.begin(), members.end(), [](const ArchiveMember& a, const ArchiveMember& b) { return a.name < b.name; });
+        outBuffer.clear();
+        for (const ArchiveMember& member : members) {
+            writeLittleEndian(outBuffer, member.name.size(), 2);
+            outBuffer.insert(outBuffer.end(), member.name.begin(), member.name.end());
+            writeLittleEndian(outBuffer, member.offset, 8);
+            writeLittleEndian(outBuffer, member.size, 8);
+            writeLittleEndian(outBuffer, member.originalSize, 8);
+        }
+        writeLittleEndian(outBuffer, indexOffset, 8);
+        writeLittleEndian(outBuffer, members.size(), 4);
+        outBuffer.insert(outBuffer.end(), ARCHIVE_INDEX_MAGIC, ARCHIVE_INDEX_MAGIC + sizeof(ARCHIVE_INDEX_MAGIC));
+        outFile.write(reinterpret_cast<const char*>(outBuffer.data()), outBuffer.size());
+        fileOffset += outBuffer.size();
+        outFile.close();
+
+        logger::log(LogLevel::Info) << "Archived " << fileCount << " file(s) and " << directories.size() << " directories, " << totalIn << " bytes into " << fileOffset
+                                    << " bytes on " << threads << " thread(s).\n";
+        return static_cast<bool>(outFile);
+    }
+
+    // Decodes every block of every member; writes the members below outputDirectory unless it is null
+    bool decodeArchive(const string& archiveFileName, const string* outputDirectory, const DecompressOptions& options) {
+        InputFile infile;
+        if (!infile.open(archiveFileName, AccessPattern::Random)) {
+            cerr << "Cannot open file: " << archiveFileName << endl;
+            return false;
+        }
+
+        // Header, trailer and central index
+        vector<unsigned char> buffer;
+        ByteSpan header;
+        ByteSpan trailer;
+        uint64_t fileSize = infile.size();
+        if (fileSize < ARCHIVE_HEADER_SIZE + ARCHIVE_TRAILER_SIZE || !infile.readAt(0, ARCHIVE_HEADER_SIZE, buffer, header)
+            || !equal(ARCHIVE_MAGIC, ARCHIVE_MAGIC + sizeof(ARCHIVE_MAGIC), header.data) || header.data[sizeof(ARCHIVE_MAGIC)] == 0
+            || header.data[sizeof(ARCHIVE_MAGIC)] > ARCHIVE_VERSION
+            || !infile.readAt(fileSize - ARCHIVE_TRAILER_SIZE, ARCHIVE_TRAILER_SIZE, buffer, trailer)
+            || !equal(ARCHIVE_INDEX_MAGIC, ARCHIVE_INDEX_MAGIC + sizeof(ARCHIVE_INDEX_MAGIC), trailer.data + 12)) {
+            cerr << "Not an archive: " << archiveFileName << endl;
+            return false;
+        }
+        uint64_t indexOffset = readLittleEndian(trailer.data, 8);
+        uint64_t memberCount = readLittleEndian(trailer.data + 8, 4);
+        ByteSpan entries;
+        if (indexOffset < ARCHIVE_HEADER_SIZE || indexOffset > fileSize - ARCHIVE_TRAILER_SIZE
+            || !infile.readAt(indexOffset, fileSize - ARCHIVE_TRAILER_SIZE - indexOffset, buffer, entries)) {
+            cerr << "Corrupt archive index in: " << archiveFileName << endl;
+            return false;
+        }
+        vector<ArchiveMember> members;
+        vector<string> directories;
+        size_t pos = 0;
+        for (uint64_t i = 0; i < memberCount; ++i) {
+            ArchiveMember member;
+            if (entries.size - pos < 2 || entries.size - pos - 2 < readLittleEndian(entries.data + pos, 2) + 24) {
+                cerr << "Corrupt archive index in: " << archiveFileName << endl;
+                return false;
+            }
+            size_t nameLength = readLittleEndian(entries.data + pos, 2);
+            member.name.assign(reinterpret_cast<const char*>(entries.data + pos + 2), nameLength);
+            pos += 2 + nameLength;
+            member.offset = readLittleEndian(entries.data + pos, 8);
+            member.size = readLittleEndian(entries.data + pos + 8, 8);
+            member.originalSize = readLittleEndian(entries.data + pos + 16, 8);
+            pos += 24;
+            if (!member.name.empty() && member.name.back() == '/') {
+                if (member.offset != 0 || member.size != 0 || member.originalSize != 0) {
+                    cerr << "Corrupt archive index in: " << archiveFileName << endl;
+                    return false;
+                }
+                if (!isSafeMemberName(member.name)) {
+                    cerr << "Unsafe path in archive: " << member.name << endl;
+                    return false;
+                }
+                directories.push_back(member.name);
+                continue;
+            }
+            if (member.offset < ARCHIVE_HEADER_SIZE || member.size > indexOffset || member.offset > indexOffset - member.size) {
+                cerr << "Corrupt archive index in: " << archiveFileName << endl;
+                return false;
+            }
+            if (!isSafeMemberName(member.name)) {
+                cerr << "Unsafe path in archive: " << member.name << endl;
+                return false;
+            }
+            members.push_back(member);
+        }
+        if (pos != entries.size) {
+            cerr << "Corrupt archive index in: " << archiveFileName << endl;
+            return false;
+        }
+
+        unsigned threads = ThreadPool::resolveThreadCount(options.threads);
+        WorkStealingPool pool(threads);
+        deque<future<bool>> pending;
+        size_t maxPending = JOBS_PER_THREAD * static_cast<size_t>(threads);
+        bool intact = true;
+        auto finishOldest = [&]() {
+            intact = pending.front().get() && intact;
+            pending.pop_front();
+        };
+
+        fs::path root(outputDirectory ? *outputDirectory : string());
+        set<fs::path> createdDirectories;
+        if (outputDirectory) {
+            for (const string& directory : directories) {
+                error_code error;
+                fs::path target = root / fs::path(directory).parent_path();
+                if (!fs::create_directories(target, error) && error) {
+                    cerr << "Cannot create directory: " << target << endl;
+                    return false;
+                }
+                createdDirectories.insert(target);
+            }
+        }
+        DecoderType decoder = options.decoder;
+        const Dictionary* dictionary = options.dictionary.get();
+        for (const ArchiveMember& member : members) {
+            string memberName = archiveFileName + ":" + member.name; // Used in error messages
+            shared_ptr<vector<BlockIndexEntry>> index = make_shared<vector<BlockIndexEntry>>(); // Shared with the block tasks
+            if (!readSeekIndex(infile, memberName, *index, dictionary, member.offset, member.size)) {
+                intact = false;
+                break;
+            }
+            uint64_t originalSize = index->empty() ? 0 : index->back().originalOffset + index->back().originalSize;
+            if (originalSize != member.originalSize) {
+                cerr << "Corrupt archive index in: " << archiveFileName << endl;
+                intact = false;
+                break;
+            }
+
+            shared_ptr<OutputDescriptor> output; // Stays null when only checking the archive
+            if (outputDirectory) {
+                fs::path target = root / fs::path(member.name);
+                error_code error;
+                if (createdDirectories.insert(target.parent_path()).second) {
+                    fs::create_directories(target.parent_path(), error);
+                }
+                output = make_shared<OutputDescriptor>();
+                output->fd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (output->fd < 0 || ::ftruncate(output->fd, static_cast<off_t>(originalSize)) != 0) {
+                    cerr << "Cannot create file: " << target << endl;
+                    intact = false;
+                    break;
+                }
+            }
+
+            // Each block is decoded and written to its place in the file by whichever worker takes it
+            for (size_t i = 0; i < index->size(); ++i) {
+                pending.push_back(pool.submit([&infile, index, i, output, decoder, dictionary, memberName]() {
+                    thread_local vector<unsigned char> input;
+                    thread_local vector<unsigned char> tableInput;
+                    thread_local string decoded;
+                    thread_local HuffmanDecodeTable table;
+                    const BlockIndexEntry& entry = (*index)[i];
+                    ByteSpan block;
+                    ByteSpan tableBlock;
+                    decoded.clear();
+                    bool ok = infile.readAt(entry.fileOffset, BLOCK_HEADER_SIZE + entry.compressedSize, input, block)
+                        && readLittleEndian(block.data, 4) == entry.originalSize
+                        && readLittleEndian(block.data + 4, 4) == entry.compressedSize
+                        && readTableBlock(infile, *index, i, block.data + BLOCK_HEADER_SIZE, entry.compressedSize, tableInput, tableBlock)
+                        && (decoder == DecoderType::Table
+                                ? decompressBlock(block.data + BLOCK_HEADER_SIZE, entry.compressedSize, entry.originalSize, decoded, table, dictionary,
+                                                  tableBlock.data, tableBlock.size)
+                                : decompressBlock(block.data + BLOCK_HEADER_SIZE, entry.compressedSize, entry.originalSize, decoded, decoder, dictionary,
+                                                  tableBlock.data, tableBlock.size));
+                    if (!ok) {
+                        cerr << "Corrupt compressed data in: " << memberName << " (block " << i << ")" << endl;
+                        return false;
+                    }
+                    if (output && !writeAt(output->fd, decoded.data(), decoded.size(), entry.originalOffset)) {
+                        cerr << "Cannot write file for: " << memberName << endl;
+                        return false;
+                    }
+                    return true;
+                }));
+                if (pending.size() >= maxPending) {
+                    finishOldest();
+                }
+            }
+            if (!intact) {
+                break;
+            }
+        }
+        while (!pending.empty()) {
+            finishOldest();
+        }
+
+        logger::log(LogLevel::Info) << (outputDirectory ? "Extracted " : "Checked ") << members.size() << " file(s) and "
+                                    << directories.size() << " directories on " << threads << " thread(s).\n";
+        return intact;
+    }
+
+    bool extractArchive(const std::string& archiveFileName, const std::string& outputDirectory, const DecompressOptions& options) {
+        return decodeArchive(archiveFileName, &outputDirectory, options);
+    }
+
+    bool verifyArchive(const std::string& archiveFileName, const DecompressOptions& options) {
+        return decodeArchive(archiveFileName, nullptr, options);
+    }
+}
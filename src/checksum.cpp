@@ -0,0 +1,130 @@
+/**
+ * @file checksum.cpp
+ * @brief CRC-32C with the SSE4.2 instruction and a portable fallback.
+ */
+#include "checksum.h"
+#include "cpuFeatures.h"
+#include <array>
+#include <cstring>
+
+#if defined(CPU_FEATURES_X86) && defined(__x86_64__)
+#include <immintrin.h>
+#define CHECKSUM_HAVE_SSE42 1
+#endif
+
+using namespace std;
+
+namespace {
+    const uint32_t POLYNOMIAL = 0x82F63B78; // Castagnoli polynomial, bit-reflected
+
+    // Tables for eight bytes per step: entry k of a byte is its remainder after k further zero bytes
+    struct SlicingTables {
+        array<array<uint32_t, 256>, 8> table;
+
+        SlicingTables() {
+            for (uint32_t byte = 0; byte < 256; ++byte) {
+                uint32_t crc = byte;
+                for (unsigned bit = 0; bit < 8; ++bit) {
+                    crc = crc & 1 ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+                }
+                table[0][byte] = crc;
+            }
+            for (uint32_t byte = 0; byte < 256; ++byte) {
+                for (unsigned k = 1; k < 8; ++k) {
+                    table[k][byte] = (table[k - 1][byte] >> 8) ^ table[0][table[k - 1][byte] & 0xFF];
+                }
+            }
+        }
+    };
+
+    uint64_t load64(const unsigned char* ptr) {
+        uint64_t value;
+        memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+
+    // Works on the register value, without the inversions at the start and end
+    uint32_t crc32cScalar(const unsigned char* data, size_t size, uint32_t state) {
+        static const SlicingTables tables;
+        const array<array<uint32_t, 256>, 8>& t = tables.table;
+        for (; size >= 8; data += 8, size -= 8) {
+            uint64_t word = load64(data) ^ state; // Little-endian: the first byte is the lowest
+            state = t[7][word & 0xFF] ^ t[6][(word >> 8) & 0xFF] ^ t[5][(word >> 16) & 0xFF] ^ t[4][(word >> 24) & 0xFF]
+                  ^ t[3][(word >> 32) & 0xFF] ^ t[2][(word >> 40) & 0xFF] ^ t[1][(word >> 48) & 0xFF] ^ t[0][word >> 56];
+        }
+        for (; size > 0; ++data, --size) {
+            state = (state >> 8) ^ t[0][(state ^ *data) & 0xFF];
+        }
+        return state;
+    }
+
+#ifdef CHECKSUM_HAVE_SSE42
+    // Product of two polynomials modulo the CRC polynomial, both bit-reflected
+    uint32_t multiplyModPolynomial(uint32_t a, uint32_t b) {
+        uint32_t product = 0;
+        for (uint32_t bit = 1u << 31; bit != 0; bit >>= 1) {
+            if (a & bit) {
+                product ^= b;
+            }
+            b = b & 1 ? (b >> 1) ^ POLYNOMIAL : b >> 1;
+        }
+        return product;
+    }
+
+    // x to the power 8 * bytes modulo the CRC polynomial: multiplying a register by it appends that many zero bytes
+    uint32_t zeroBytesOperator(uint64_t bytes) {
+        uint32_t power = 1u << 30; // x^8 is reached from x^1 by three squarings
+        for (unsigned i = 0; i < 3; ++i) {
+            power = multiplyModPolynomial(power, power);
+        }
+        uint32_t result = 1u << 31; // x^0
+        for (; bytes > 0; bytes >>= 1) {
+            if (bytes & 1) {
+                result = multiplyModPolynomial(result, power);
+            }
+            power = multiplyModPolynomial(power, power);
+        }
+        return result;
+    }
+
+    const size_t LANE_THRESHOLD = 4096; // Below this, joining three lanes costs more than it saves
+
+    // The crc32 instruction takes three cycles but a new one can start every cycle, so large buffers are split into
+    // three lanes checksummed side by side; the lane results are then joined by appending zero bytes and adding
+    __attribute__((target("sse4.2")))
+    uint32_t crc32cSse42(const unsigned char* data, size_t size, uint32_t state) {
+        if (size >= LANE_THRESHOLD) {
+            size_t lane = size / 24 * 8;
+            uint64_t first = state, second = 0, third = 0;
+            for (const unsigned char* end = data + lane; data < end; data += 8) {
+                first = _mm_crc32_u64(first, load64(data));
+                second = _mm_crc32_u64(second, load64(data + lane));
+                third = _mm_crc32_u64(third, load64(data + 2 * lane));
+            }
+            uint32_t shift = zeroBytesOperator(lane);
+            state = multiplyModPolynomial(static_cast<uint32_t>(first), shift) ^ static_cast<uint32_t>(second);
+            state = multiplyModPolynomial(state, shift) ^ static_cast<uint32_t>(third);
+            data += 2 * lane;
+            size -= 3 * lane;
+        }
+        uint64_t wide = state;
+        for (; size >= 8; data += 8, size -= 8) {
+            wide = _mm_crc32_u64(wide, load64(data));
+        }
+        state = static_cast<uint32_t>(wide);
+        for (; size > 0; ++data, --size) {
+            state = _mm_crc32_u8(state, *data);
+        }
+        return state;
+    }
+#endif
+}
+
+uint32_t crc32c(const unsigned char* data, size_t size, uint32_t crc) {
+#ifdef CHECKSUM_HAVE_SSE42
+    if (cpuLevel() >= CpuLevel::Sse42) {
+        return ~crc32cSse42(data, size, ~crc);
+    }
+#endif
+    return ~crc32cScalar(data, size, ~crc);
+}
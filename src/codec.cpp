@@ -0,0 +1,267 @@
+/**
+ * @file codec.cpp
+ * @brief In-memory and streaming compression contexts.
+ */
+#include "codec.h"
+#include "dictionary.h"
+#include "format.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using fileHandles::ByteSpan;
+
+namespace compressor {
+    Compressor::Compressor(const CompressOptions& options)
+        : options(options), blockSize(min(max(options.blockSize, MIN_BLOCK_SIZE), MAX_BLOCK_SIZE)) {
+        tables.publish(StreamTable());
+        messageTables.publish(StreamTable());
+    }
+
+    // Writes the whole message straight into out, with no intermediate copy; uses its own index and table link,
+    // so a message being pushed at the same time is not disturbed
+    void Compressor::compress(const unsigned char* data, size_t size, vector<unsigned char>& out) {
+        size_t start = out.size();
+        messageIndex.clear();
+        messageTables.publish(StreamTable());
+        writeFileHeader(out, blockSize, options.dictionary.get());
+        for (size_t pos = 0; pos < size; pos += blockSize) {
+            size_t length = min(blockSize, size - pos);
+            uint64_t blockNumber = messageIndex.size() / INDEX_ENTRY_SIZE;
+            addIndexEntry(messageIndex, out.size() - start, length);
+            compressBlock(data + pos, length, out, options, blockNumber, &messageTables, &messageTables);
+        }
+        writeFileEnd(out, messageIndex, out.size() - start);
+    }
+
+    void Compressor::compress(ByteSpan input, vector<unsigned char>& out) {
+        compress(input.data, input.size, out);
+    }
+
+    bool Compressor::push(const unsigned char* data, size_t size) {
+        if (finished) {
+            return false;
+        }
+        begin();
+        while (size > 0) {
+            if (input.empty() && size >= blockSize) {
+                appendBlock(data, blockSize); // Whole blocks are coded from the caller's memory
+                data += blockSize;
+                size -= blockSize;
+                continue;
+            }
+            size_t length = min(blockSize - input.size(), size);
+            input.insert(input.end(), data, data + length);
+            data += length;
+            size -= length;
+            if (input.size() == blockSize) {
+                appendBlock(input.data(), input.size());
+                input.clear();
+            }
+        }
+        return true;
+    }
+
+    void Compressor::finish() {
+        if (finished) {
+            return;
+        }
+        begin();
+        if (!input.empty()) {
+            appendBlock(input.data(), input.size());
+            input.clear();
+        }
+        size_t before = output.size();
+        writeFileEnd(output, seekIndex, produced);
+        produced += output.size() - before;
+        finished = true;
+    }
+
+    size_t Compressor::pull(unsigned char* dest, size_t capacity) {
+        size_t length = min(capacity, output.size() - outputPos);
+        memcpy(dest, output.data() + outputPos, length);
+        outputPos += length;
+        if (outputPos == output.size()) {
+            output.clear(); // Drained; start filling from the front again
+            outputPos = 0;
+        }
+        return length;
+    }
+
+    size_t Compressor::available() const {
+        return output.size() - outputPos;
+    }
+
+    bool Compressor::done() const {
+        return finished && available() == 0;
+    }
+
+    void Compressor::reset() {
+        input.clear();
+        output.clear();
+        outputPos = 0;
+        seekIndex.clear();
+        tables.publish(StreamTable());
+        produced = 0;
+        started = false;
+        finished = false;
+    }
+
+    // Writes the file header before the first block of a message
+    void Compressor::begin() {
+        if (started) {
+            return;
+        }
+        size_t before = output.size();
+        writeFileHeader(output, blockSize, options.dictionary.get());
+        produced += output.size() - before;
+        started = true;
+    }
+
+    void Compressor::appendBlock(const unsigned char* data, size_t size) {
+        uint64_t blockNumber = seekIndex.size() / INDEX_ENTRY_SIZE;
+        addIndexEntry(seekIndex, produced, size);
+        size_t before = output.size();
+        compressBlock(data, size, output, options, blockNumber, &tables, &tables);
+        produced += output.size() - before;
+    }
+
+    Decompressor::Decompressor(const DecompressOptions& options) : dictionary(options.dictionary) {}
+
+    bool Decompressor::decompress(const unsigned char* data, size_t size, string& out) {
+        reset();
+        size_t used = parse(data, size, out);
+        return state == State::Done && used == size;
+    }
+
+    bool Decompressor::decompress(ByteSpan input, string& out) {
+        return decompress(input.data, input.size, out);
+    }
+
+    bool Decompressor::push(const unsigned char* data, size_t size) {
+        if (state == State::Failed) {
+            return false;
+        }
+        if (input.empty()) {
+            // Parse straight from the caller's memory and keep only the incomplete tail
+            size_t used = parse(data, size, output);
+            input.assign(data + used, data + size);
+        } else {
+            input.insert(input.end(), data, data + size);
+            size_t used = parse(input.data(), input.size(), output);
+            input.erase(input.begin(), input.begin() + used);
+        }
+        return state != State::Failed;
+    }
+
+    size_t Decompressor::pull(unsigned char* dest, size_t capacity) {
+        size_t length = min(capacity, output.size() - outputPos);
+        memcpy(dest, output.data() + outputPos, length);
+        outputPos += length;
+        if (outputPos == output.size()) {
+            output.clear();
+            outputPos = 0;
+        }
+        return length;
+    }
+
+    size_t Decompressor::available() const {
+        return output.size() - outputPos;
+    }
+
+    bool Decompressor::done() const {
+        return state == State::Done && available() == 0;
+    }
+
+    bool Decompressor::failed() const {
+        return state == State::Failed;
+    }
+
+    void Decompressor::reset() {
+        state = State::Header;
+        blockSize = 0;
+        blockCount = 0;
+        consumed = 0;
+        lastTable.clear();
+        lastTableBlock = 0;
+        input.clear();
+        output.clear();
+        outputPos = 0;
+    }
+
+    // Consumes every complete header, block and index in data; returns the bytes used
+    size_t Decompressor::parse(const unsigned char* data, size_t size, string& out) {
+        size_t pos = 0;
+        for (;;) {
+            size_t remaining = size - pos;
+            if (state == State::Header) {
+                if (remaining < FILE_HEADER_SIZE) {
+                    break;
+                }
+                uint32_t dictionaryId = 0;
+                if (!readFileHeader(data + pos, blockSize, dictionaryId) || blockSize == 0 || !dictionaryMatches(dictionaryId, dictionary.get())) {
+                    state = State::Failed;
+                    break;
+                }
+                pos += FILE_HEADER_SIZE;
+                state = State::Blocks;
+            } else if (state == State::Blocks) {
+                if (remaining < BLOCK_HEADER_SIZE) {
+                    break;
+                }
+                uint64_t originalSize = readLittleEndian(data + pos, 4);
+                uint64_t compressedSize = readLittleEndian(data + pos + 4, 4);
+                if (originalSize == 0 && compressedSize == 0) {
+                    pos += BLOCK_HEADER_SIZE; // End-of-stream marker
+                    state = State::Index;
+                    continue;
+                }
+                if (originalSize == 0 || originalSize > blockSize || compressedSize > maxCompressedBlockSize(originalSize)) {
+                    state = State::Failed;
+                    break;
+                }
+                if (remaining < BLOCK_HEADER_SIZE + compressedSize) {
+                    break;
+                }
+                // Blocks reusing a table always refer to the latest block that stored one
+                const unsigned char* block = data + pos + BLOCK_HEADER_SIZE;
+                uint64_t blocksBack = 0;
+                if (tableReference(block, compressedSize, blocksBack) && (lastTable.empty() || blockCount - lastTableBlock != blocksBack)) {
+                    state = State::Failed;
+                    break;
+                }
+                if (!decompressBlock(block, compressedSize, originalSize, out, table, dictionary.get(), lastTable.data(), lastTable.size())) {
+                    state = State::Failed;
+                    break;
+                }
+                if (compressedSize > 0 && blockMode(block[0]) == BlockMode::Table) {
+                    lastTable.assign(block, block + min<uint64_t>(compressedSize, 1 + 256));
+                    lastTableBlock = blockCount;
+                }
+                pos += BLOCK_HEADER_SIZE + compressedSize;
+                ++blockCount;
+            } else if (state == State::Index) {
+                size_t indexSize = blockCount * INDEX_ENTRY_SIZE + TRAILER_SIZE;
+                if (remaining < indexSize) {
+                    break;
+                }
+                // The trailer must point back at the index just read and count the blocks decoded
+                const unsigned char* trailer = data + pos + indexSize - TRAILER_SIZE;
+                if (readLittleEndian(trailer, 8) != consumed + pos || readLittleEndian(trailer + 8, 4) != blockCount
+                    || !equal(INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC), trailer + 12)) {
+                    state = State::Failed;
+                    break;
+                }
+                pos += indexSize;
+                state = State::Done;
+            } else {
+                if (state == State::Done && remaining > 0) {
+                    state = State::Failed; // Bytes after the trailer
+                }
+                break;
+            }
+        }
+        consumed += pos;
+        return pos;
+    }
+}
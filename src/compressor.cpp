@@ -1,102 +1,1264 @@
 #include "compressor.h"
+#include "ans.h"
+#include "checksum.h"
+#include "codec.h"
+#include "dictionary.h"
+#include "format.h"
 #include "huffman.h"
+#include "lz77.h"
 #include "fileHandles.h"
+#include "bitstream.h"
+#include "boundedQueue.h"
+#include "threadPool.h"
+#include "logger.h"
+#include <array>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <map>
-#include <bitset>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace fileHandles;
+using logger::LogLevel;
 namespace compressor { 
-    map<char, string> HuffmanCode;         // Map to store the Huffman code for each character
-    MinHeap theMinHeap;                    // MinHeap to manage the Huffman nodes
+    const char FILE_MAGIC[4] = {'H', 'U', 'F', 'Z'};
+    const unsigned char FORMAT_VERSION = 4;
+    const size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+    const size_t MIN_BLOCK_SIZE = 1 << 10;
+    const size_t MAX_BLOCK_SIZE = 1 << 28;
+    const unsigned DEFAULT_MAX_CODE_LENGTH = HuffmanDecodeTable::PRIMARY_BITS; // Every code resolves in one table probe
+    const unsigned MIN_CODE_LENGTH_LIMIT = 8;   // Enough for all 256 byte values
+    const unsigned MAX_CODE_LENGTH_LIMIT = 32;
+    const char INDEX_MAGIC[4] = {'H', 'U', 'F', 'I'};
+    const size_t FILE_HEADER_SIZE = 13;    // Magic, version, block size and dictionary id
+    const size_t BLOCK_HEADER_SIZE = 8;    // Uncompressed and compressed size fields
+    const size_t INDEX_ENTRY_SIZE = 12;    // Block offset and uncompressed size
+    const size_t TRAILER_SIZE = 16;        // Index offset, block count and index magic
+    const unsigned char FOUR_STREAMS_FLAG = 0x80;
+    const size_t JUMP_TABLE_SIZE = 12;     // Byte sizes of the first three of four streams
+    const size_t STREAM_CHUNK_SIZE = 1 << 20; // Bytes read at a time from input that cannot be seeked
+    const unsigned char CHECKSUM_FLAG = 0x40;
+    const size_t CHECKSUM_SIZE = 4;        // CRC-32C of the uncompressed block
 
-    // Builds the Huffman tree from the frequency map using the MinHeap
-    HuffmanNode* buildHuffmanTree(map<char, unsigned>& frequency_map, MinHeap& minHeap) {
-        for (const auto& pair : frequency_map) {
-            minHeap.insert(new HuffmanNode(pair.first, pair.second)); // Insert each character as a node in the MinHeap
+    // Code length limit actually applied: the option clamped to the accepted range
+    unsigned codeLengthLimit(const CompressOptions& options) {
+        return min(max(options.maxCodeLength, MIN_CODE_LENGTH_LIMIT), MAX_CODE_LENGTH_LIMIT);
+    }
+
+    // Sums count times code length over all byte values
+    uint64_t codedBits(const ByteHistogram& histogram, const HuffmanCodeTable& table) {
+        uint64_t bits = 0;
+        for (size_t symbol = 0; symbol < histogram.size(); ++symbol) {
+            bits += histogram[symbol] * table[symbol].length;
+        }
+        return bits;
+    }
+
+    // Derives canonical codes no longer than maxLength for every byte value present in the histogram;
+    // returns the payload size plain Huffman codes would have needed
+    uint64_t buildCodeTable(const ByteHistogram& histogram, unsigned maxLength, HuffmanCodeTable& table) {
+        FlatHuffmanTree tree;  // Fixed-size node array on the stack, so blocks can be coded concurrently
+        tree.build(histogram);
+        tree.codeLengths(table);
+        uint64_t unboundedBits = codedBits(histogram, table);
+
+        unsigned longest = 0;
+        for (const HuffmanCodeEntry& entry : table) {
+            longest = max<unsigned>(longest, entry.length);
+        }
+        if (longest > maxLength) {
+            buildLengthLimitedCodeLengths(histogram, maxLength, table); // Only skewed blocks need the slower exact limit
         }
+        buildCanonicalCodes(table); // Assign canonical codes of the same lengths
+        return unboundedBits;
+    }
 
-        // Combine nodes until only one remains in the MinHeap
-        while (minHeap.size() > 1) {
-            HuffmanNode* left = minHeap.extractMin();    // Extract the node with the smallest frequency
-            HuffmanNode* right = minHeap.extractMin();   // Extract the next smallest frequency node
-            HuffmanNode* internalNode = new HuffmanNode(left, right); // Create a new internal node
-            minHeap.insert(internalNode);                // Insert the new internal node back into the MinHeap
+    // Appends a little-endian integer of the given width to the buffer
+    void writeLittleEndian(vector<unsigned char>& out, uint64_t value, unsigned bytes) {
+        for (unsigned i = 0; i < bytes; ++i) {
+            out.push_back(static_cast<unsigned char>(value >> (8 * i)));
         }
+    }
 
-        return minHeap.extractMin(); // The remaining node is the root of the Huffman tree
+    // Reads a little-endian integer of the given width from memory
+    uint64_t readLittleEndian(const unsigned char* data, unsigned bytes) {
+        uint64_t value = 0;
+        for (unsigned i = 0; i < bytes; ++i) {
+            value |= uint64_t(data[i]) << (8 * i);
+        }
+        return value;
     }
 
-    // Compresses the input file using Huffman coding and writes the result to the output file
-    void compress(const std::string& inputFileName, const std::string& outputFileName) {
-        cout << "\nBuilding the Huffman tree...\n";
-        HuffmanNode* root = buildHuffmanTree(frequency_map, theMinHeap); // Build the Huffman tree from the frequency map
-        cout << "\nHuffman tree built.\n";
-        root->printTree(root); // Optional: Print the Huffman tree for debugging
+    // Appends magic, version, block size and dictionary id
+    void writeFileHeader(vector<unsigned char>& out, size_t blockSize, const Dictionary* dictionary) {
+        out.insert(out.end(), FILE_MAGIC, FILE_MAGIC + sizeof(FILE_MAGIC));
+        out.push_back(FORMAT_VERSION);
+        writeLittleEndian(out, blockSize, 4);
+        writeLittleEndian(out, dictionary ? dictionary->id : 0, 4);
+    }
 
-        cout << "\nEncoding the Huffman tree...\n";
-        root->encode("", HuffmanCode); // Generate Huffman codes for each character
-        cout << "\nHuffman tree encoded.\n";
+    // Checks magic and version and reads the block size and dictionary id
+    bool readFileHeader(const unsigned char* data, uint64_t& blockSize, uint32_t& dictionaryId) {
+        if (!equal(FILE_MAGIC, FILE_MAGIC + sizeof(FILE_MAGIC), data) || data[sizeof(FILE_MAGIC)] != FORMAT_VERSION) {
+            return false;
+        }
+        blockSize = readLittleEndian(data + sizeof(FILE_MAGIC) + 1, 4);
+        dictionaryId = static_cast<uint32_t>(readLittleEndian(data + sizeof(FILE_MAGIC) + 5, 4));
+        return true;
+    }
 
-        ofstream outFile(outputFileName, ios::binary);
-        if (!outFile) {
-            cerr << "Cannot create file: " << outputFileName << endl;
+    bool dictionaryMatches(uint32_t dictionaryId, const Dictionary* dictionary) {
+        return dictionaryId == 0 || (dictionary && dictionary->id == dictionaryId);
+    }
+
+    uint64_t maxCompressedBlockSize(uint64_t originalSize) {
+        return 1 + 256 + (originalSize * MAX_CODE_LENGTH_LIMIT + 7) / 8 + CHECKSUM_SIZE;
+    }
+
+    void addIndexEntry(vector<unsigned char>& seekIndex, uint64_t fileOffset, uint64_t originalSize) {
+        writeLittleEndian(seekIndex, fileOffset, 8);
+        writeLittleEndian(seekIndex, originalSize, 4);
+    }
+
+    // End-of-stream marker, then the seek index and its trailer
+    void writeFileEnd(vector<unsigned char>& out, const vector<unsigned char>& seekIndex, uint64_t blocksEnd) {
+        out.insert(out.end(), BLOCK_HEADER_SIZE, 0);
+        uint64_t indexOffset = blocksEnd + BLOCK_HEADER_SIZE;
+        out.insert(out.end(), seekIndex.begin(), seekIndex.end());
+        writeLittleEndian(out, indexOffset, 8);
+        writeLittleEndian(out, seekIndex.size() / INDEX_ENTRY_SIZE, 4);
+        out.insert(out.end(), INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+    }
+
+    // Appends the code lengths of all 256 byte values, run-length coding unused values
+    void writeCodeLengths(const HuffmanCodeTable& table, vector<unsigned char>& out) {
+        size_t symbol = 0;
+        while (symbol < table.size()) {
+            if (table[symbol].length > 0) {
+                out.push_back(table[symbol].length);
+                ++symbol;
+                continue;
+            }
+            size_t run = 0;
+            while (symbol < table.size() && table[symbol].length == 0 && run < 128) {
+                ++run;
+                ++symbol;
+            }
+            out.push_back(static_cast<unsigned char>(0x80 | (run - 1)));
+        }
+    }
+
+    // Reads code lengths written by writeCodeLengths; returns the bytes consumed or 0 if malformed
+    size_t readCodeLengths(const unsigned char* data, size_t size, HuffmanCodeTable& table) {
+        size_t symbol = 0;
+        size_t pos = 0;
+        while (symbol < table.size() && pos < size) {
+            unsigned char value = data[pos++];
+            if (value & 0x80) {
+                symbol += (value & 0x7F) + 1; // Run of byte values without a code
+            } else {
+                table[symbol++].length = value;
+            }
+        }
+        return symbol == table.size() ? pos : 0;
+    }
+
+    // Size of the code lengths as written by writeCodeLengths, in bits, for the byte values present in the histogram
+    uint64_t codeLengthsBits(const ByteHistogram& histogram) {
+        uint64_t bytes = 0;
+        size_t run = 0; // Length of the current run of unused byte values
+        for (uint64_t count : histogram) {
+            if (count > 0) {
+                ++bytes;
+                run = 0;
+            } else if (run++ % 128 == 0) {
+                ++bytes;
+            }
+        }
+        return 8 * bytes;
+    }
+
+    // Entropy of the histogram plus its code lengths: no table of the block's own can take fewer bits
+    double ownTableBitsBound(const ByteHistogram& histogram, size_t size) {
+        double bits = 0;
+        for (uint64_t count : histogram) {
+            if (count > 0) {
+                bits += count * log2(static_cast<double>(size) / count);
+            }
+        }
+        return bits + codeLengthsBits(histogram);
+    }
+
+    BlockMode blockMode(unsigned char modeByte) {
+        return static_cast<BlockMode>(modeByte & ~(FOUR_STREAMS_FLAG | CHECKSUM_FLAG));
+    }
+
+    const char* blockModeName(BlockMode mode) {
+        switch (mode) {
+        case BlockMode::Table: return "table";
+        case BlockMode::Dictionary: return "dictionary";
+        case BlockMode::Raw: return "raw";
+        case BlockMode::Run: return "run";
+        case BlockMode::Repeat: return "repeat";
+        case BlockMode::Ans: return "ans";
+        case BlockMode::Lz: return "lz";
+        }
+        return "";
+    }
+
+    void TableLink::publish(const StreamTable& newTable) {
+        lock_guard<mutex> lock(tableMutex);
+        table = newTable;
+        published = true;
+        ready.notify_all();
+    }
+
+    const StreamTable& TableLink::wait() {
+        unique_lock<mutex> lock(tableMutex);
+        ready.wait(lock, [this]() { return published; });
+        return table;
+    }
+
+    // Checks that every byte value present in the histogram has a code
+    bool coversHistogram(const ByteHistogram& histogram, const HuffmanCodeTable& codes) {
+        for (size_t symbol = 0; symbol < histogram.size(); ++symbol) {
+            if (histogram[symbol] > 0 && codes[symbol].length == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Appends the payload as one bit stream, or as four streams of consecutive quarters of the data after a jump table
+    void encodePayload(const unsigned char* data, size_t size, const HuffmanCodeTable& codes, bool fourStreams, vector<unsigned char>& out) {
+        if (!fourStreams) {
+            encodeHuffman(data, size, codes, out);
             return;
         }
+        size_t jumpTable = out.size();
+        out.insert(out.end(), JUMP_TABLE_SIZE, 0); // Filled in as the streams are written
+        for (unsigned s = 0; s < 4; ++s) {
+            size_t streamStart = out.size();
+            size_t begin = static_cast<size_t>(min<uint64_t>(s * ((uint64_t(size) + 3) / 4), size));
+            encodeHuffman(data + begin, static_cast<size_t>(interleavedStreamSymbols(size, s)), codes, out);
+            if (s < 3) {
+                size_t streamSize = out.size() - streamStart;
+                for (unsigned i = 0; i < 4; ++i) {
+                    out[jumpTable + 4 * s + i] = static_cast<unsigned char>(streamSize >> (8 * i));
+                }
+            }
+        }
+    }
+
+    // Locates the four streams of a payload from its jump table; returns false if they do not fit
+    bool splitPayload(const unsigned char* data, size_t size, const unsigned char* streams[4], size_t sizes[4]) {
+        if (size < JUMP_TABLE_SIZE) {
+            return false;
+        }
+        size_t pos = JUMP_TABLE_SIZE;
+        for (unsigned s = 0; s < 4; ++s) {
+            sizes[s] = s < 3 ? static_cast<size_t>(readLittleEndian(data + 4 * s, 4)) : size - pos;
+            if (sizes[s] > size - pos) {
+                return false;
+            }
+            streams[s] = data + pos;
+            pos += sizes[s];
+        }
+        return true;
+    }
+
+    // Decodes a payload of one or four streams with the table decoder
+    bool decodePayload(const HuffmanDecodeTable& table, const unsigned char* data, size_t size, uint64_t count, bool fourStreams, string& out) {
+        if (!fourStreams) {
+            return table.decode(data, size, count, out);
+        }
+        const unsigned char* streams[4];
+        size_t sizes[4];
+        return splitPayload(data, size, streams, sizes) && table.decodeFour(streams, sizes, count, out);
+    }
+
+    // Decodes a payload of one or four streams with the tree decoder, one stream after another
+    bool decodePayload(HuffmanNode* root, const unsigned char* data, size_t size, uint64_t count, bool fourStreams, string& out) {
+        if (!fourStreams) {
+            return root->decode(data, size, count, out);
+        }
+        const unsigned char* streams[4];
+        size_t sizes[4];
+        if (!splitPayload(data, size, streams, sizes)) {
+            return false;
+        }
+        for (unsigned s = 0; s < 4; ++s) {
+            if (!root->decode(streams[s], sizes[s], interleavedStreamSymbols(count, s), out)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Appends one LZ77 stream of byte codes: its code lengths, the payload size, then the payload
+    void encodeLzStream(const vector<unsigned char>& stream, unsigned maxLength, bool fourStreams, vector<unsigned char>& out) {
+        ByteHistogram histogram{};
+        countBytes(stream.data(), stream.size(), histogram);
+        HuffmanCodeTable codes{};
+        if (!stream.empty()) {
+            buildCodeTable(histogram, maxLength, codes);
+        }
+        writeCodeLengths(codes, out);
+        size_t sizeField = out.size();
+        writeLittleEndian(out, 0, 4);
+        encodePayload(stream.data(), stream.size(), codes, fourStreams, out);
+        size_t payloadSize = out.size() - sizeField - 4;
+        for (unsigned i = 0; i < 4; ++i) {
+            out[sizeField + i] = static_cast<unsigned char>(payloadSize >> (8 * i));
+        }
+    }
+
+    // Parses the block into sequences and appends them as Huffman-coded literal, literal length, match length and
+    // distance streams with a table each, then the extra bits of the lengths and distances
+    void encodeLzBlock(const unsigned char* data, size_t size, unsigned level, unsigned maxLength, bool fourStreams, vector<unsigned char>& out) {
+        thread_local LzMatchFinder finder; // Tables and buffers reused by every block this thread codes
+        thread_local vector<LzSequence> sequences;
+        thread_local vector<unsigned char> literals, literalLengthCodes, matchLengthCodes, distanceCodes, extra;
+        finder.parse(data, size, level, sequences, literals);
+
+        literalLengthCodes.resize(sequences.size());
+        matchLengthCodes.resize(sequences.size());
+        distanceCodes.resize(sequences.size());
+        extra.clear();
+        BitWriter writer(extra);
+        auto putValue = [&](uint32_t value, unsigned char& code) {
+            unsigned bits = 0;
+            code = static_cast<unsigned char>(lzValueCode(value, bits));
+            writer.put(value & ((uint64_t(1) << bits) - 1), bits);
+        };
+        for (size_t i = 0; i < sequences.size(); ++i) {
+            putValue(sequences[i].literalLength, literalLengthCodes[i]);
+            putValue(sequences[i].matchLength - LZ_MIN_MATCH, matchLengthCodes[i]);
+            putValue(sequences[i].distance - 1, distanceCodes[i]);
+        }
+        writer.flush();
+
+        writeLittleEndian(out, sequences.size(), 4);
+        writeLittleEndian(out, literals.size(), 4);
+        encodeLzStream(literals, maxLength, fourStreams, out);
+        encodeLzStream(literalLengthCodes, maxLength, fourStreams, out);
+        encodeLzStream(matchLengthCodes, maxLength, fourStreams, out);
+        encodeLzStream(distanceCodes, maxLength, fourStreams, out);
+        writeLittleEndian(out, extra.size(), 4);
+        out.insert(out.end(), extra.begin(), extra.end());
+    }
+
+    BlockStats compressBlock(const unsigned char* data, size_t size, vector<unsigned char>& out, const CompressOptions& options) {
+        return compressBlock(data, size, out, options, 0, nullptr, nullptr);
+    }
+
+    // Compresses one block: histogram, then the cheapest mode by exact coded size, then the payload.
+    // The block's own table is built only if its entropy bound beats every cheaper mode; with an LZ77
+    // level the block is also coded as sequences, which are kept if they are smaller still.
+    BlockStats compressBlock(const unsigned char* data, size_t size, vector<unsigned char>& out, const CompressOptions& options,
+                             uint64_t blockNumber, TableLink* previous, TableLink* next) {
+        BlockStats stats;
+        StageTimer timer;
+        ByteHistogram histogram{};
+        countBytes(data, size, histogram); // Count each character in the block
+        timer.stop(stats.times, Stage::Histogram);
+
+        // Sizes below leave out the block header and mode byte, which every mode has
+        BlockMode mode = BlockMode::Raw;
+        uint64_t bestBits = 8 * static_cast<uint64_t>(size);
+        uint64_t payloadBits = bestBits; // Part of bestBits that is coded data rather than tables
+        bool fourStreams = options.streams == 4;
+        uint64_t jumpBits = fourStreams ? 8 * JUMP_TABLE_SIZE : 0; // Every Huffman payload then starts with a jump table
+        size_t symbols = count_if(histogram.begin(), histogram.end(), [](uint64_t count) { return count > 0; });
+        if (symbols == 1) {
+            mode = BlockMode::Run;
+            bestBits = 8;
+            payloadBits = 0;
+        }
+        const Dictionary* dictionary = options.dictionary.get();
+        if (dictionary && codedBits(histogram, dictionary->codes) + jumpBits < bestBits) {
+            mode = BlockMode::Dictionary;
+            payloadBits = codedBits(histogram, dictionary->codes);
+            bestBits = payloadBits + jumpBits;
+        }
+        static const StreamTable noTable;
+        const StreamTable& before = previous ? previous->wait() : noTable;
+        if (before.present && blockNumber - before.block <= UINT32_MAX && coversHistogram(histogram, before.codes)
+            && codedBits(histogram, before.codes) + 32 + jumpBits < bestBits) {
+            mode = BlockMode::Repeat;
+            payloadBits = codedBits(histogram, before.codes);
+            bestBits = payloadBits + 32 + jumpBits;
+        }
+        unsigned maxLength = codeLengthLimit(options);
+        HuffmanCodeTable codes;
+        AnsCounts ansCounts;
+        thread_local vector<unsigned char> ansHeader; // Scaled counts as stored in the block
+        if (mode != BlockMode::Run && ownTableBitsBound(histogram, size) < bestBits) {
+            // Both coders are priced and the smaller kept; the codec option only breaks ties
+            uint64_t unboundedBits = buildCodeTable(histogram, maxLength, codes);
+            uint64_t tableBits = codedBits(histogram, codes);
+            uint64_t huffmanBits = tableBits + codeLengthsBits(histogram) + jumpBits;
+            normalizeAnsCounts(histogram, size, ansCounts);
+            ansHeader.clear();
+            writeAnsCounts(ansCounts, ansHeader);
+            uint64_t ansBits = ansCodedBits(histogram, ansCounts);
+            uint64_t ansTotalBits = ansBits + 8 * ansHeader.size() + ansCounts.tableLog + 15; // Final state, padding byte and partial byte
+            if (ansTotalBits < huffmanBits || (ansTotalBits == huffmanBits && options.codec == Codec::Ans)) {
+                if (ansTotalBits < bestBits) {
+                    mode = BlockMode::Ans;
+                    bestBits = ansTotalBits;
+                    payloadBits = ansBits;
+                }
+            } else if (huffmanBits < bestBits) {
+                mode = BlockMode::Table;
+                stats.unboundedPayloadBits = unboundedBits;
+                bestBits = huffmanBits;
+                payloadBits = tableBits;
+            }
+        }
+        thread_local vector<unsigned char> lzBody; // Coded sequences, kept only if smaller than every mode above
+        if (options.level > 0 && mode != BlockMode::Run) {
+            lzBody.clear();
+            encodeLzBlock(data, size, options.level, maxLength, fourStreams, lzBody);
+            if (8 * lzBody.size() < bestBits) {
+                mode = BlockMode::Lz;
+                bestBits = payloadBits = 8 * lzBody.size();
+            }
+        }
+        stats.payloadBits = payloadBits;
+        if (mode != BlockMode::Table) {
+            stats.unboundedPayloadBits = stats.payloadBits; // No limit was applied to this block's codes
+        }
+        if (next) {
+            // Later blocks may reuse a table stored here; publish before encoding so they need not wait for it
+            next->publish(mode == BlockMode::Table ? StreamTable{codes, blockNumber, true} : before);
+        }
+        timer.stop(stats.times, Stage::Build);
+
+        size_t start = out.size();
+        writeLittleEndian(out, size, 4);
+        writeLittleEndian(out, 0, 4); // Compressed size, filled in below
+        bool huffmanPayload = mode == BlockMode::Dictionary || mode == BlockMode::Repeat || mode == BlockMode::Table || mode == BlockMode::Lz;
+        out.push_back(static_cast<unsigned char>(mode) | (fourStreams && huffmanPayload ? FOUR_STREAMS_FLAG : 0));
+        switch (mode) {
+        case BlockMode::Raw:
+            out.insert(out.end(), data, data + size); // Incompressible: copied as is
+            break;
+        case BlockMode::Run:
+            out.push_back(data[0]);
+            break;
+        case BlockMode::Dictionary:
+            encodePayload(data, size, dictionary->codes, fourStreams, out);
+            break;
+        case BlockMode::Repeat:
+            writeLittleEndian(out, blockNumber - before.block, 4);
+            encodePayload(data, size, before.codes, fourStreams, out);
+            break;
+        case BlockMode::Table:
+            writeCodeLengths(codes, out);
+            encodePayload(data, size, codes, fourStreams, out);
+            break;
+        case BlockMode::Lz:
+            out.insert(out.end(), lzBody.begin(), lzBody.end());
+            break;
+        case BlockMode::Ans: {
+            AnsEncoder encoder; // Fixed-size tables on the stack, like the Huffman tree
+            encoder.build(ansCounts);
+            out.insert(out.end(), ansHeader.begin(), ansHeader.end());
+            encoder.encode(data, size, out);
+            if (out.size() - start - BLOCK_HEADER_SIZE > 1 + size) { // The estimate rounds; never store more than raw
+                out.resize(start + BLOCK_HEADER_SIZE);
+                out.push_back(static_cast<unsigned char>(BlockMode::Raw));
+                out.insert(out.end(), data, data + size);
+                mode = BlockMode::Raw;
+                stats.payloadBits = stats.unboundedPayloadBits = 8 * static_cast<uint64_t>(size);
+            }
+            break;
+        }
+        }
+        if (options.checksum) {
+            out[start + BLOCK_HEADER_SIZE] |= CHECKSUM_FLAG;
+            writeLittleEndian(out, crc32c(data, size), CHECKSUM_SIZE); // The block is still in cache from encoding
+        }
+
+        size_t compressedSize = out.size() - start - BLOCK_HEADER_SIZE;
+        for (unsigned i = 0; i < 4; ++i) {
+            out[start + 4 + i] = static_cast<unsigned char>(compressedSize >> (8 * i));
+        }
+        timer.stop(stats.times, Stage::Encode);
+
+        stats.originalSize = size;
+        stats.compressedSize = out.size() - start;
+        stats.mode = blockModeName(mode);
+        return stats;
+    }
+
+    bool tableReference(const unsigned char* data, size_t size, uint64_t& blocksBack) {
+        if (size < 5 || blockMode(data[0]) != BlockMode::Repeat) {
+            return false;
+        }
+        blocksBack = readLittleEndian(data + 1, 4);
+        return true;
+    }
+
+    // Decodes blocks that need no codes (raw and run blocks); returns false if the block has another mode
+    bool decodeUncoded(const unsigned char* data, size_t size, size_t originalSize, string& out, bool& decoded) {
+        if (blockMode(data[0]) == BlockMode::Raw) {
+            decoded = size == 1 + originalSize;
+            if (decoded) {
+                out.append(reinterpret_cast<const char*>(data + 1), originalSize);
+            }
+            return true;
+        }
+        if (blockMode(data[0]) == BlockMode::Run) {
+            decoded = size == 2;
+            if (decoded) {
+                out.append(originalSize, static_cast<char>(data[1]));
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Decodes a tANS block: the scaled counts, then the bit stream
+    bool decodeAnsBlock(const unsigned char* data, size_t size, size_t originalSize, string& out) {
+        AnsCounts counts;
+        size_t countsSize = readAnsCounts(data + 1, size - 1, counts);
+        if (countsSize == 0) {
+            return false;
+        }
+        AnsDecodeTable table;
+        table.build(counts);
+        return table.decode(data + 1 + countsSize, size - 1 - countsSize, originalSize, out);
+    }
+
+    // Decodes one LZ77 stream written by encodeLzStream with the table decoder, or the tree decoder if table is null;
+    // returns the bytes consumed, or 0 if the stream is corrupt
+    size_t decodeLzStream(const unsigned char* data, size_t size, uint64_t count, bool fourStreams, string& out, HuffmanDecodeTable* table) {
+        HuffmanCodeTable codes{};
+        size_t lengthsSize = readCodeLengths(data, size, codes);
+        if (lengthsSize == 0 || size - lengthsSize < 4) {
+            return 0;
+        }
+        size_t payload = lengthsSize + 4;
+        uint64_t payloadSize = readLittleEndian(data + lengthsSize, 4);
+        if (payloadSize > size - payload) {
+            return 0;
+        }
+        out.clear();
+        if (count > 0) {
+            bool decoded = buildCanonicalCodes(codes);
+            if (decoded && table) {
+                decoded = table->build(codes) && decodePayload(*table, data + payload, payloadSize, count, fourStreams, out);
+            } else if (decoded) {
+                HuffmanNode* root = HuffmanNode::fromCodes(codes);
+                decoded = decodePayload(root, data + payload, payloadSize, count, fourStreams, out);
+                delete root;
+            }
+            if (!decoded) {
+                return 0;
+            }
+        }
+        return payload + payloadSize;
+    }
+
+    // Decodes an LZ77 block: the four code streams, then the sequences are replayed with their extra bits
+    bool decodeLzBlock(const unsigned char* data, size_t size, size_t originalSize, string& out, HuffmanDecodeTable* table) {
+        if (size < 9) {
+            return false;
+        }
+        uint64_t sequenceCount = readLittleEndian(data + 1, 4);
+        uint64_t literalCount = readLittleEndian(data + 5, 4);
+        if (sequenceCount > originalSize || literalCount > originalSize) {
+            return false;
+        }
+        thread_local string literals, literalLengthCodes, matchLengthCodes, distanceCodes; // Reused by every block this thread decodes
+        size_t pos = 9;
+        for (string* stream : {&literals, &literalLengthCodes, &matchLengthCodes, &distanceCodes}) {
+            size_t used = decodeLzStream(data + pos, size - pos, stream == &literals ? literalCount : sequenceCount, data[0] & FOUR_STREAMS_FLAG,
+                                         *stream, table);
+            if (used == 0) {
+                return false;
+            }
+            pos += used;
+        }
+        if (size - pos < 4 || readLittleEndian(data + pos, 4) != size - pos - 4) {
+            return false;
+        }
+        BitReader extra(data + pos + 4, size - pos - 4);
+
+        size_t first = out.size();
+        out.resize(first + originalSize);
+        unsigned char* begin = reinterpret_cast<unsigned char*>(&out[0]) + first;
+        unsigned char* end = begin + originalSize;
+        unsigned char* dest = begin;
+        const unsigned char* literal = reinterpret_cast<const unsigned char*>(literals.data());
+        const unsigned char* literalEnd = literal + literals.size();
+        auto readValue = [&](unsigned char code, uint64_t& value) {
+            unsigned bits = 0;
+            if (code >= LZ_VALUE_CODES) {
+                return false;
+            }
+            value = lzValueBase(code, bits) + extra.read(bits);
+            return true;
+        };
+        for (uint64_t i = 0; i < sequenceCount; ++i) {
+            uint64_t literalLength, matchLength, distance;
+            if (!readValue(literalLengthCodes[i], literalLength) || !readValue(matchLengthCodes[i], matchLength)
+                || !readValue(distanceCodes[i], distance)) {
+                return false;
+            }
+            matchLength += LZ_MIN_MATCH;
+            distance += 1;
+            if (literalLength > uint64_t(literalEnd - literal) || literalLength + matchLength > uint64_t(end - dest)
+                || distance > uint64_t(dest - begin) + literalLength) {
+                return false;
+            }
+            memcpy(dest, literal, literalLength);
+            literal += literalLength;
+            dest += literalLength;
+            lzCopyMatch(dest, distance, matchLength, end);
+            dest += matchLength;
+        }
+        if (uint64_t(literalEnd - literal) != uint64_t(end - dest)) {
+            return false;
+        }
+        memcpy(dest, literal, literalEnd - literal); // Literals after the last match
+        return !extra.overrun();
+    }
+
+    // Loads the codes of a Table or Repeat block; returns the offset of its payload, or 0 if the block is corrupt
+    size_t readBlockCodes(const unsigned char* data, size_t size, const unsigned char* tableBlock, size_t tableBlockSize, HuffmanCodeTable& codes) {
+        size_t payload = 0;
+        if (blockMode(data[0]) == BlockMode::Table) {
+            size_t tableSize = readCodeLengths(data + 1, size - 1, codes);
+            payload = tableSize ? 1 + tableSize : 0;
+        } else if (blockMode(data[0]) == BlockMode::Repeat && size >= 5 && tableBlock && tableBlockSize > 1
+                   && blockMode(tableBlock[0]) == BlockMode::Table) {
+            payload = readCodeLengths(tableBlock + 1, tableBlockSize - 1, codes) ? 5 : 0;
+        }
+        return payload && buildCanonicalCodes(codes) ? payload : 0;
+    }
+
+    // Decodes one block, checksum removed, with the tree decoder
+    bool decodeWithTree(const unsigned char* data, size_t size, size_t originalSize, string& out, const Dictionary* dictionary,
+                        const unsigned char* tableBlock, size_t tableBlockSize) {
+        bool decoded = false;
+        if (decodeUncoded(data, size, originalSize, out, decoded)) {
+            return decoded;
+        }
+        if (blockMode(data[0]) == BlockMode::Ans) {
+            return decodeAnsBlock(data, size, originalSize, out); // No Huffman codes to walk
+        }
+        if (blockMode(data[0]) == BlockMode::Lz) {
+            return decodeLzBlock(data, size, originalSize, out, nullptr);
+        }
+        HuffmanCodeTable codes{};
+        size_t payload = 1; // Mode byte
+        if (blockMode(data[0]) == BlockMode::Dictionary) {
+            if (!dictionary) {
+                return false;
+            }
+            codes = dictionary->codes;
+        } else {
+            payload = readBlockCodes(data, size, tableBlock, tableBlockSize, codes);
+            if (payload == 0) {
+                return false;
+            }
+        }
+        HuffmanNode* root = HuffmanNode::fromCodes(codes); // Rebuild a tree holding the canonical codes
+        decoded = decodePayload(root, data + payload, size - payload, originalSize, data[0] & FOUR_STREAMS_FLAG, out);
+        delete root;
+        return decoded;
+    }
 
-        ifstream inFile(inputFileName, ios::binary);
-        char tempChar;
-        string encodedContent;
-        while (inFile.get(tempChar)) {
-            encodedContent += HuffmanCode[tempChar]; // Replace each character with its Huffman code
+    // Decodes one block, checksum removed, with the table decoder, rebuilding the given table in place unless the block uses the dictionary's
+    bool decodeWithTable(const unsigned char* data, size_t size, size_t originalSize, string& out, HuffmanDecodeTable& table,
+                         const Dictionary* dictionary, const unsigned char* tableBlock, size_t tableBlockSize) {
+        bool decoded = false;
+        if (decodeUncoded(data, size, originalSize, out, decoded)) {
+            return decoded;
+        }
+        bool fourStreams = data[0] & FOUR_STREAMS_FLAG;
+        if (blockMode(data[0]) == BlockMode::Dictionary) {
+            return dictionary && decodePayload(dictionary->decodeTable, data + 1, size - 1, originalSize, fourStreams, out);
+        }
+        if (blockMode(data[0]) == BlockMode::Ans) {
+            return decodeAnsBlock(data, size, originalSize, out);
         }
+        if (blockMode(data[0]) == BlockMode::Lz) {
+            return decodeLzBlock(data, size, originalSize, out, &table);
+        }
+        HuffmanCodeTable codes{};
+        size_t payload = readBlockCodes(data, size, tableBlock, tableBlockSize, codes);
+        if (payload == 0) {
+            return false;
+        }
+        if (!table.build(codes)) { // Build the lookup tables straight from the code lengths
+            return originalSize == 0;
+        }
+        return decodePayload(table, data + payload, size - payload, originalSize, fourStreams, out);
+    }
 
-        // Ensure the encoded content length is a multiple of 8 by padding with zeros
-        while (encodedContent.size() % 8 != 0) {
-            encodedContent += '0';
+    // Runs decode on the block without its checksum, then compares the checksum with the bytes decode appended to out
+    template <typename Decode>
+    bool decodeChecked(const unsigned char* data, size_t size, string& out, Decode decode) {
+        if (size == 0) {
+            return false;
         }
+        if (!(data[0] & CHECKSUM_FLAG)) {
+            return decode(size);
+        }
+        if (size < 1 + CHECKSUM_SIZE) {
+            return false;
+        }
+        size -= CHECKSUM_SIZE;
+        size_t first = out.size();
+        return decode(size) && crc32c(reinterpret_cast<const unsigned char*>(out.data()) + first, out.size() - first)
+            == readLittleEndian(data + size, CHECKSUM_SIZE);
+    }
 
-        // Write the encoded content as bytes to the output file
-        for (size_t i = 0; i < encodedContent.size(); i += 8) {
-            bitset<8> byte(encodedContent.substr(i, 8)); // Convert each 8-bit chunk to a byte
-            outFile.put(static_cast<unsigned char>(byte.to_ulong())); // Write the byte to the output file
+    // Decodes one block with the requested decoder
+    bool decompressBlock(const unsigned char* data, size_t size, size_t originalSize, string& out, DecoderType decoder, const Dictionary* dictionary,
+                         const unsigned char* tableBlock, size_t tableBlockSize) {
+        if (decoder == DecoderType::Table) {
+            HuffmanDecodeTable table;
+            return decompressBlock(data, size, originalSize, out, table, dictionary, tableBlock, tableBlockSize);
         }
+        return decodeChecked(data, size, out, [&](size_t payloadSize) {
+            return decodeWithTree(data, payloadSize, originalSize, out, dictionary, tableBlock, tableBlockSize);
+        });
+    }
 
-        inFile.close();
-        outFile.close();
+    bool decompressBlock(const unsigned char* data, size_t size, size_t originalSize, string& out, HuffmanDecodeTable& table,
+                         const Dictionary* dictionary, const unsigned char* tableBlock, size_t tableBlockSize) {
+        return decodeChecked(data, size, out, [&](size_t payloadSize) {
+            return decodeWithTable(data, payloadSize, originalSize, out, table, dictionary, tableBlock, tableBlockSize);
+        });
+    }
+
+    // Opens the output file, or hands out standard output for STANDARD_STREAM; returns null after printing an error
+    ostream* openOutput(const string& outputFileName, ofstream& file) {
+        if (outputFileName == STANDARD_STREAM) {
+            return &cout;
+        }
+        file.open(outputFileName, ios::binary);
+        if (!file) {
+            cerr << "Cannot create file: " << outputFileName << endl;
+            return nullptr;
+        }
+        return &file;
+    }
+
+    // Closes output opened with openOutput; returns false if any write failed
+    bool closeOutput(ostream& out, ofstream& file) {
+        if (&out == &file) {
+            file.close();
+        } else {
+            out.flush();
+        }
+        return static_cast<bool>(out);
+    }
+
+    // Compresses the input file block by block and writes each block as soon as it is ready
+    bool compress(const std::string& inputFileName, const std::string& outputFileName, const CompressOptions& options, RunStats* stats) {
+        chrono::steady_clock::time_point wallStart = chrono::steady_clock::now();
+        double cpuStart = processCpuSeconds();
+        RunStats run;                             // Filled in as blocks are written, handed to stats at the end
+        run.operation = "compress";
+        StageTimer timer;                         // Read and write time of this thread
+
+        InputFile inFile;
+        if (!inFile.open(inputFileName, AccessPattern::Sequential)) {
+            cerr << "Cannot open file: " << inputFileName << endl;
+            return false;
+        }
+        ofstream file;
+        ostream* output = openOutput(outputFileName, file);
+        if (!output) {
+            return false;
+        }
+        ostream& outFile = *output;
+
+        size_t blockSize = min(max(options.blockSize, MIN_BLOCK_SIZE), MAX_BLOCK_SIZE);
+
+        // Write the header: magic, version and block size
+        vector<unsigned char> outBuffer;
+        writeFileHeader(outBuffer, blockSize, options.dictionary.get());
+        timer = StageTimer();
+        outFile.write(reinterpret_cast<const char*>(outBuffer.data()), outBuffer.size());
+        timer.stop(run.stages, Stage::Write);
+        uint64_t fileOffset = outBuffer.size();   // Bytes written so far
+        vector<unsigned char> seekIndex;          // One entry per block, written after the blocks
+
+        // Three stages overlap: this thread reads blocks, the pool codes them and a writer thread writes them strictly
+        // in input order, so the output does not depend on the thread count. A fixed ring of job buffers circulates
+        // between the stages; when the writer falls behind, the reader waits for a free buffer.
+        struct BlockJob {
+            ByteSpan input;                // Uncompressed block, in the mapping or in buffer
+            vector<unsigned char> buffer;  // Storage for input that is not memory-mapped
+            vector<unsigned char> output;  // Compressed block
+            BlockStats stats;              // Size figures and stage times for the block
+        };
+        unsigned threads = ThreadPool::resolveThreadCount(options.threads);
+        ThreadPool pool(threads);
+        size_t ringSize = 2 * static_cast<size_t>(threads) + 2;  // Bounds memory to a few blocks per thread
+        BoundedQueue<shared_ptr<BlockJob>> freeJobs(ringSize);    // Buffers ready for the reader
+        BoundedQueue<pair<shared_ptr<BlockJob>, future<void>>> codedJobs(ringSize); // Blocks being coded, oldest first
+        for (size_t i = 0; i < ringSize; ++i) {
+            freeJobs.push(make_shared<BlockJob>());
+        }
+        size_t blockCount = 0;
+        BlockStats totals;                                        // Sum over all blocks
+        shared_ptr<TableLink> lastTable = make_shared<TableLink>(); // Table in effect after the latest block handed out
+        lastTable->publish(StreamTable());
+
+        // Only the writer touches the output file, the index and run until it is joined
+        thread writer([&]() {
+            pair<shared_ptr<BlockJob>, future<void>> coded;
+            while (codedJobs.pop(coded)) {
+                coded.second.get();
+                shared_ptr<BlockJob> job = move(coded.first);
+                totals.payloadBits += job->stats.payloadBits;
+                totals.unboundedPayloadBits += job->stats.unboundedPayloadBits;
+                addIndexEntry(seekIndex, fileOffset, job->input.size);
+                StageTimer writeTimer;
+                outFile.write(reinterpret_cast<const char*>(job->output.data()), job->output.size());
+                writeTimer.stop(job->stats.times, Stage::Write);
+                fileOffset += job->output.size();
+                run.bytesIn += job->input.size;
+                addStageTimes(run.stages, job->stats.times);
+                if (stats) {
+                    run.blocks.push_back(job->stats);
+                }
+                freeJobs.push(move(job));
+            }
+        });
+
+        StageTimes lastReadTime{}; // The read that found the end of the input
+        for (;;) {
+            shared_ptr<BlockJob> job;
+            freeJobs.pop(job);
+            timer = StageTimer();
+            job->input = inFile.next(blockSize, job->buffer);
+            inFile.prefetch(job->input);
+            StageTimes readTime{};
+            timer.stop(readTime, Stage::Read);
+            if (job->input.size == 0) {
+                lastReadTime = readTime;
+                break;
+            }
+            uint64_t blockNumber = blockCount++;
+
+            // Each block may reuse the table of the one before; the pool runs tasks in order, so the block waited for is always running
+            shared_ptr<TableLink> previousTable = lastTable;
+            lastTable = make_shared<TableLink>();
+            codedJobs.push({job, pool.submit([job, &options, readTime, blockNumber, previousTable, nextTable = lastTable]() {
+                job->output.clear();
+                job->stats = compressBlock(job->input.data, job->input.size, job->output, options, blockNumber, previousTable.get(), nextTable.get());
+                job->stats.times[size_t(Stage::Read)] = readTime[size_t(Stage::Read)];
+            })});
+        }
+        codedJobs.close();
+        writer.join();
+        addStageTimes(run.stages, lastReadTime);
+
+        // End-of-stream marker, then the seek index and its trailer
+        outBuffer.clear();
+        writeFileEnd(outBuffer, seekIndex, fileOffset);
+        fileOffset += outBuffer.size();
+        timer = StageTimer();
+        outFile.write(reinterpret_cast<const char*>(outBuffer.data()), outBuffer.size());
+        bool written = closeOutput(outFile, file);
+        timer.stop(run.stages, Stage::Write);
+        logger::log(LogLevel::Info) << "Compressed " << blockCount << " block(s) of up to " << blockSize << " bytes on " << threads << " thread(s).\n";
+        uint64_t limitCost = totals.payloadBits - totals.unboundedPayloadBits;
+        logger::log(LogLevel::Info) << "Limiting codes to " << codeLengthLimit(options) << " bits cost " << (limitCost + 7) / 8 << " byte(s) ("
+                                    << (totals.unboundedPayloadBits ? 100.0 * limitCost / totals.unboundedPayloadBits : 0.0)
+                                    << "% of the payload) over unbounded Huffman codes.\n";
+
+        if (stats) {
+            run.bytesOut = fileOffset;
+            run.ratio = run.bytesOut ? static_cast<double>(run.bytesIn) / run.bytesOut : 0;
+            run.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - wallStart).count();
+            run.cpuSeconds = processCpuSeconds() - cpuStart;
+            run.peakResidentBytes = peakResidentBytes();
+            *stats = move(run);
+        }
+        if (inFile.failed()) {
+            cerr << "Error reading file: " << inputFileName << endl;
+            return false;
+        }
+        return written;
+    }
+
+    bool readSeekIndex(InputFile& infile, const string& inputFileName, vector<BlockIndexEntry>& index, const Dictionary* dictionary) {
+        return readSeekIndex(infile, inputFileName, index, dictionary, 0, infile.size());
+    }
+
+    // Checks the file header and loads the seek index from the trailer of the stream
+    // occupying streamSize bytes at streamOffset
+    bool readSeekIndex(InputFile& infile, const string& inputFileName, vector<BlockIndexEntry>& index, const Dictionary* dictionary,
+                       uint64_t streamOffset, uint64_t streamSize) {
+        uint64_t fileSize = streamSize;
+        vector<unsigned char> buffer;
+        ByteSpan header;
+        uint64_t blockSize = 0;
+        uint32_t dictionaryId = 0;
+        if (fileSize < FILE_HEADER_SIZE || !infile.readAt(streamOffset, FILE_HEADER_SIZE, buffer, header)
+            || !readFileHeader(header.data, blockSize, dictionaryId)) {
+            cerr << "Not a compressed file: " << inputFileName << endl;
+            return false;
+        }
+        if (!dictionaryMatches(dictionaryId, dictionary)) {
+            cerr << (dictionary ? "Wrong dictionary for: " : "A dictionary (--dict) is needed to decompress: ") << inputFileName << endl;
+            return false;
+        }
+
+        ByteSpan trailer;
+        if (fileSize < FILE_HEADER_SIZE + BLOCK_HEADER_SIZE + TRAILER_SIZE
+            || !infile.readAt(streamOffset + fileSize - TRAILER_SIZE, TRAILER_SIZE, buffer, trailer)
+            || !equal(INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC), trailer.data + 12)) {
+            cerr << "Missing seek index in: " << inputFileName << endl;
+            return false;
+        }
+        uint64_t indexOffset = readLittleEndian(trailer.data, 8);
+        uint64_t blockCount = readLittleEndian(trailer.data + 8, 4);
+        if (indexOffset < FILE_HEADER_SIZE + BLOCK_HEADER_SIZE || indexOffset + blockCount * INDEX_ENTRY_SIZE + TRAILER_SIZE != fileSize) {
+            cerr << "Corrupt seek index in: " << inputFileName << endl;
+            return false;
+        }
+
+        ByteSpan entries;
+        if (!infile.readAt(streamOffset + indexOffset, blockCount * INDEX_ENTRY_SIZE, buffer, entries)) {
+            cerr << "Corrupt seek index in: " << inputFileName << endl;
+            return false;
+        }
+
+        index.clear();
+        uint64_t originalOffset = 0;
+        uint64_t endOfBlocks = indexOffset - BLOCK_HEADER_SIZE; // Position of the end-of-stream marker
+        for (size_t i = 0; i < blockCount; ++i) {
+            BlockIndexEntry entry;
+            entry.fileOffset = readLittleEndian(entries.data + i * INDEX_ENTRY_SIZE, 8);
+            entry.originalSize = readLittleEndian(entries.data + i * INDEX_ENTRY_SIZE + 8, 4);
+            entry.originalOffset = originalOffset;
+            uint64_t next = i + 1 < blockCount ? readLittleEndian(entries.data + (i + 1) * INDEX_ENTRY_SIZE, 8) : endOfBlocks;
+            if (entry.fileOffset < FILE_HEADER_SIZE || next < entry.fileOffset + BLOCK_HEADER_SIZE
+                || entry.originalSize == 0 || entry.originalSize > blockSize) {
+                cerr << "Corrupt seek index in: " << inputFileName << endl;
+                return false;
+            }
+            entry.compressedSize = next - entry.fileOffset - BLOCK_HEADER_SIZE;
+            entry.fileOffset += streamOffset;
+            originalOffset += entry.originalSize;
+            index.push_back(entry);
+        }
+        return true;
+    }
+
+    bool readTableBlock(InputFile& infile, const vector<BlockIndexEntry>& index, size_t block, const unsigned char* data, size_t size,
+                        vector<unsigned char>& buffer, ByteSpan& tableBlock) {
+        uint64_t blocksBack = 0;
+        tableBlock = ByteSpan();
+        if (!tableReference(data, size, blocksBack)) {
+            return true;
+        }
+        if (blocksBack == 0 || blocksBack > block) {
+            return false;
+        }
+        const BlockIndexEntry& entry = index[block - blocksBack];
+        return infile.readAt(entry.fileOffset + BLOCK_HEADER_SIZE, min<uint64_t>(entry.compressedSize, 1 + 256), buffer, tableBlock);
+    }
+
+    // Reads blocks first..last-1, decodes them on the pool and passes each decoded block to consume in order;
+    // the read, decode and consume (write) time of each block is recorded in run
+    bool decodeBlocks(InputFile& infile, const string& inputFileName, const vector<BlockIndexEntry>& index, size_t first, size_t last,
+                      const DecompressOptions& options, const function<void(const BlockIndexEntry&, const string&)>& consume,
+                      RunStats& run, bool keepBlocks) {
+        struct DecodeJob {
+            ByteSpan input;                // Block header, code lengths and payload
+            vector<unsigned char> buffer;  // Storage for input that is not memory-mapped
+            ByteSpan tableInput;           // Code lengths of the block whose table this one reuses
+            vector<unsigned char> tableBuffer; // Storage for tableInput when not memory-mapped
+            string output;                 // Decoded block
+            BlockStats stats;              // Sizes and stage times for the block
+        };
+        // This thread reads blocks, the pool decodes them and a writer thread hands them to consume in order,
+        // with a fixed ring of job buffers circulating between the three
+        unsigned threads = ThreadPool::resolveThreadCount(options.threads);
+        ThreadPool pool(threads);
+        size_t ringSize = 2 * static_cast<size_t>(threads) + 2;
+        BoundedQueue<shared_ptr<DecodeJob>> freeJobs(ringSize);
+        BoundedQueue<pair<shared_ptr<DecodeJob>, future<bool>>> decodedJobs(ringSize); // Blocks being decoded, oldest first
+        for (size_t i = 0; i < ringSize; ++i) {
+            freeJobs.push(make_shared<DecodeJob>());
+        }
+        atomic<bool> intact{true};
+        size_t badBlock = last;     // First block that could not be decoded; set by the writer
+        size_t unreadBlock = last;  // Block that could not be read; set by this thread
+
+        thread writer([&]() {
+            size_t nextToWrite = first;
+            pair<shared_ptr<DecodeJob>, future<bool>> decoded;
+            while (decodedJobs.pop(decoded)) {
+                shared_ptr<DecodeJob> job = move(decoded.first);
+                if (!decoded.second.get()) {
+                    badBlock = min(badBlock, nextToWrite);
+                    intact = false;
+                } else if (intact) {
+                    StageTimer timer;
+                    consume(index[nextToWrite], job->output);
+                    timer.stop(job->stats.times, Stage::Write);
+                    addStageTimes(run.stages, job->stats.times);
+                    run.bytesIn += job->stats.compressedSize;
+                    if (keepBlocks) {
+                        run.blocks.push_back(job->stats);
+                    }
+                }
+                ++nextToWrite;
+                freeJobs.push(move(job)); // Keep draining after a failure so the reader is never left waiting
+            }
+        });
+
+        DecoderType decoder = options.decoder;
+        const Dictionary* dictionary = options.dictionary.get();
+        for (size_t i = first; i < last && intact; ++i) {
+            const BlockIndexEntry& entry = index[i];
+            shared_ptr<DecodeJob> job;
+            freeJobs.pop(job);
+
+            // Read the block and check its header against the index
+            StageTimer timer;
+            if (!infile.readAt(entry.fileOffset, BLOCK_HEADER_SIZE + entry.compressedSize, job->buffer, job->input)
+                || readLittleEndian(job->input.data, 4) != entry.originalSize || readLittleEndian(job->input.data + 4, 4) != entry.compressedSize
+                || !readTableBlock(infile, index, i, job->input.data + BLOCK_HEADER_SIZE, entry.compressedSize, job->tableBuffer, job->tableInput)) {
+                unreadBlock = i;
+                intact = false;
+                break;
+            }
+            infile.prefetch(job->input);
+            job->stats = BlockStats();
+            job->stats.originalSize = entry.originalSize;
+            job->stats.compressedSize = job->input.size;
+            timer.stop(job->stats.times, Stage::Read);
+
+            size_t originalSize = entry.originalSize;
+            decodedJobs.push({job, pool.submit([job, originalSize, decoder, dictionary]() {
+                StageTimer timer;
+                job->output.clear();
+                bool decoded = decompressBlock(job->input.data + BLOCK_HEADER_SIZE, job->input.size - BLOCK_HEADER_SIZE, originalSize, job->output,
+                                               decoder, dictionary, job->tableInput.data, job->tableInput.size);
+                timer.stop(job->stats.times, Stage::Decode);
+                return decoded;
+            })});
+        }
+        decodedJobs.close();
+        writer.join();
+        badBlock = min(badBlock, unreadBlock);
+
+        if (!intact) {
+            cerr << "Corrupt compressed data in: " << inputFileName << " (block " << badBlock << ")" << endl;
+        }
+        return intact;
+    }
+
+    // Decodes input that cannot be seeked, such as a pipe, front to back without the seek index, passing the
+    // uncompressed bytes to consume as they become available; the read, decode and write time is recorded in run
+    bool decodeStream(InputFile& infile, const string& inputFileName, const DecompressOptions& options,
+                      const function<void(const unsigned char*, size_t)>& consume, RunStats& run) {
+        Decompressor decompressor(options);
+        vector<unsigned char> buffer;  // Storage for each chunk read
+        vector<unsigned char> decoded(STREAM_CHUNK_SIZE);
+        for (;;) {
+            StageTimer timer;
+            ByteSpan chunk = infile.next(STREAM_CHUNK_SIZE, buffer);
+            timer.stop(run.stages, Stage::Read);
+            if (chunk.size == 0) {
+                break;
+            }
+            run.bytesIn += chunk.size;
+            timer = StageTimer();
+            bool intact = decompressor.push(chunk.data, chunk.size);
+            timer.stop(run.stages, Stage::Decode);
+            timer = StageTimer();
+            while (decompressor.available() > 0) {
+                size_t length = decompressor.pull(decoded.data(), decoded.size());
+                consume(decoded.data(), length);
+            }
+            timer.stop(run.stages, Stage::Write);
+            if (!intact) {
+                break;
+            }
+        }
+        if (infile.failed()) {
+            cerr << "Error reading file: " << inputFileName << endl;
+            return false;
+        }
+        if (!decompressor.done()) {
+            cerr << "Corrupt compressed data in: " << inputFileName << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Fills in the run-wide figures of a decompress or extract run and hands them to the caller
+    void finishDecodeStats(RunStats& run, chrono::steady_clock::time_point wallStart, double cpuStart, RunStats& stats) {
+        uint64_t decodedBytes = 0;
+        for (const BlockStats& block : run.blocks) {
+            decodedBytes += block.originalSize;
+        }
+        if (run.blocks.empty()) {
+            decodedBytes = run.bytesOut; // Streamed input is decoded without per-block figures
+        }
+        run.ratio = run.bytesIn ? static_cast<double>(decodedBytes) / run.bytesIn : 0;
+        run.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - wallStart).count();
+        run.cpuSeconds = processCpuSeconds() - cpuStart;
+        run.peakResidentBytes = peakResidentBytes();
+        stats = move(run);
     }
 
     // Decompresses the input file and writes the result to the output file
-    void decompress(const std::string& inputFileName, const std::string& outputFileName) {
-        ifstream infile(inputFileName, ios::binary);
-        ofstream outfile(outputFileName, ios::binary);
+    bool decompress(const std::string& inputFileName, const std::string& outputFileName, const DecompressOptions& options, RunStats* stats) {
+        chrono::steady_clock::time_point wallStart = chrono::steady_clock::now();
+        double cpuStart = processCpuSeconds();
+        RunStats run;
+        run.operation = "decompress";
 
-        if (!infile) {
+        InputFile infile;
+        if (!infile.open(inputFileName, AccessPattern::Sequential)) {
             cerr << "Cannot open file: " << inputFileName << endl;
-            return;
+            return false;
+        }
+        vector<BlockIndexEntry> index;
+        if (infile.isSeekable() && !readSeekIndex(infile, inputFileName, index, options.dictionary.get())) {
+            return false;
+        }
+
+        ofstream file;
+        ostream* output = openOutput(outputFileName, file);
+        if (!output) {
+            return false;
+        }
+        ostream& outfile = *output;
+        bool decoded = false;
+        if (infile.isSeekable()) {
+            decoded = decodeBlocks(infile, inputFileName, index, 0, index.size(), options,
+                [&outfile, &run](const BlockIndexEntry&, const string& block) {
+                    outfile.write(block.data(), block.size()); // Write the decoded block to the output file
+                    run.bytesOut += block.size();
+                }, run, stats != nullptr);
+        } else {
+            decoded = decodeStream(infile, inputFileName, options, [&outfile, &run](const unsigned char* data, size_t size) {
+                outfile.write(reinterpret_cast<const char*>(data), size);
+                run.bytesOut += size;
+            }, run);
         }
 
-        // Read the frequency table size from the input file
-        size_t frequencyTableSize;
-        infile.read(reinterpret_cast<char*>(&frequencyTableSize), sizeof(frequencyTableSize));
-        frequency_map.clear();
+        bool written = closeOutput(outfile, file);
+        if (stats) {
+            finishDecodeStats(run, wallStart, cpuStart, *stats);
+        }
+        return decoded && written;
+    }
 
-        // Read the frequency table from the input file
-        for (size_t i = 0; i < frequencyTableSize; ++i) {
-            char ch;
-            unsigned int freq;
-            infile.get(ch);
-            infile.read(reinterpret_cast<char*>(&freq), sizeof(freq));
-            frequency_map[ch] = freq; // Rebuild the frequency map
+    // Decodes only the blocks overlapping the requested range and writes that range
+    bool extract(const std::string& inputFileName, const std::string& outputFileName, uint64_t offset, uint64_t length, const DecompressOptions& options,
+                 RunStats* stats) {
+        chrono::steady_clock::time_point wallStart = chrono::steady_clock::now();
+        double cpuStart = processCpuSeconds();
+        RunStats run;
+        run.operation = "extract";
+
+        InputFile infile;
+        if (!infile.open(inputFileName, AccessPattern::Random)) {
+            cerr << "Cannot open file: " << inputFileName << endl;
+            return false;
+        }
+        if (!infile.isSeekable()) {
+            cerr << "Extract needs a seekable file, not a pipe: " << inputFileName << endl;
+            return false;
+        }
+        vector<BlockIndexEntry> index;
+        if (!readSeekIndex(infile, inputFileName, index, options.dictionary.get())) {
+            return false;
         }
 
-        HuffmanNode* root = buildHuffmanTree(frequency_map, theMinHeap); // Rebuild the Huffman tree
-        HuffmanNode* huffmanPtr = root;
-        root->decode(huffmanPtr, infile, outfile); // Decode the content using the Huffman tree
+        uint64_t totalSize = index.empty() ? 0 : index.back().originalOffset + index.back().originalSize;
+        if (offset > totalSize) {
+            cerr << "Offset " << offset << " is past the end of the data (" << totalSize << " bytes)." << endl;
+            return false;
+        }
+        uint64_t end = offset + min(length, totalSize - offset);
 
-        infile.close();
-        outfile.close();
+        // Find the first block ending after offset and the first block starting at or after end
+        auto endsAfter = [](const BlockIndexEntry& entry, uint64_t position) { return entry.originalOffset + entry.originalSize <= position; };
+        size_t first = lower_bound(index.begin(), index.end(), offset, endsAfter) - index.begin();
+        size_t last = first;
+        while (last < index.size() && index[last].originalOffset < end) {
+            ++last;
+        }
+
+        ofstream file;
+        ostream* output = openOutput(outputFileName, file);
+        if (!output) {
+            return false;
+        }
+        ostream& outfile = *output;
+        bool decoded = decodeBlocks(infile, inputFileName, index, first, last, options,
+            [&outfile, &run, offset, end](const BlockIndexEntry& entry, const string& block) {
+                uint64_t from = max(offset, entry.originalOffset) - entry.originalOffset;
+                uint64_t to = min(end, entry.originalOffset + entry.originalSize) - entry.originalOffset;
+                outfile.write(block.data() + from, to - from); // Write the part of the block inside the range
+                run.bytesOut += to - from;
+            }, run, stats != nullptr);
+        logger::log(LogLevel::Info) << "Decoded " << (last - first) << " of " << index.size() << " block(s).\n";
+
+        bool written = closeOutput(outfile, file);
+        if (stats) {
+            finishDecodeStats(run, wallStart, cpuStart, *stats);
+        }
+        return decoded && written;
+    }
+
+    // Decodes every block as decompress does but keeps only the byte count
+    bool verify(const std::string& inputFileName, const DecompressOptions& options, RunStats* stats) {
+        chrono::steady_clock::time_point wallStart = chrono::steady_clock::now();
+        double cpuStart = processCpuSeconds();
+        RunStats run;
+        run.operation = "verify";
+
+        InputFile infile;
+        if (!infile.open(inputFileName, AccessPattern::Sequential)) {
+            cerr << "Cannot open file: " << inputFileName << endl;
+            return false;
+        }
+        vector<BlockIndexEntry> index;
+        bool decoded = false;
+        if (!infile.isSeekable()) {
+            decoded = decodeStream(infile, inputFileName, options, [&run](const unsigned char*, size_t size) {
+                run.bytesOut += size;
+            }, run);
+        } else if (readSeekIndex(infile, inputFileName, index, options.dictionary.get())) {
+            decoded = decodeBlocks(infile, inputFileName, index, 0, index.size(), options,
+                [&run](const BlockIndexEntry&, const string& block) {
+                    run.bytesOut += block.size();
+                }, run, stats != nullptr);
+            logger::log(LogLevel::Info) << "Checked " << index.size() << " block(s).\n";
+        }
+
+        if (stats) {
+            finishDecodeStats(run, wallStart, cpuStart, *stats);
+        }
+        return decoded;
     }
-} // namespace compressor
\ No newline at end of file
+} // namespace compressor
@@ -0,0 +1,65 @@
+/**
+ * @file cpuFeatures.cpp
+ * @brief Detection and override of the instruction set used by the hot kernels.
+ */
+#include "cpuFeatures.h"
+#include <atomic>
+
+using namespace std;
+
+namespace {
+    CpuLevel detect() {
+#ifdef CPU_FEATURES_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("sse4.2")) {
+            return CpuLevel::Avx2;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+            return CpuLevel::Sse42;
+        }
+#endif
+        return CpuLevel::Scalar;
+    }
+
+    // Level in use; read on every kernel call, so it is a relaxed atomic rather than a lock
+    atomic<CpuLevel>& activeLevel() {
+        static atomic<CpuLevel> level(detectedCpuLevel());
+        return level;
+    }
+}
+
+CpuLevel detectedCpuLevel() {
+    static const CpuLevel level = detect();
+    return level;
+}
+
+CpuLevel cpuLevel() {
+    return activeLevel().load(memory_order_relaxed);
+}
+
+bool setCpuLevel(CpuLevel level) {
+    if (level > detectedCpuLevel()) {
+        return false;
+    }
+    activeLevel().store(level, memory_order_relaxed);
+    return true;
+}
+
+const char* cpuLevelName(CpuLevel level) {
+    switch (level) {
+    case CpuLevel::Scalar: return "scalar";
+    case CpuLevel::Sse42: return "sse4.2";
+    case CpuLevel::Avx2: return "avx2";
+    }
+    return "";
+}
+
+bool parseCpuLevel(const string& name, CpuLevel& level) {
+    for (CpuLevel candidate : {CpuLevel::Scalar, CpuLevel::Sse42, CpuLevel::Avx2}) {
+        if (name == cpuLevelName(candidate)) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
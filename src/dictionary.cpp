@@ -0,0 +1,129 @@
+/**
+ * @file dictionary.cpp
+ * @brief Training, saving and loading of shared Huffman tables.
+ */
+#include "dictionary.h"
+#include "fileHandles.h"
+#include "format.h"
+#include "logger.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+using namespace std;
+using namespace fileHandles;
+using logger::LogLevel;
+namespace fs = std::filesystem;
+
+namespace compressor {
+    const char DICTIONARY_MAGIC[4] = {'H', 'U', 'F', 'T'};
+    const unsigned char DICTIONARY_VERSION = 1;
+
+    namespace {
+        const size_t DICTIONARY_FILE_SIZE = sizeof(DICTIONARY_MAGIC) + 1 + 256;
+
+        // FNV-1a hash of the code lengths; 0 is kept for files without a dictionary
+        uint32_t dictionaryId(const HuffmanCodeTable& codes) {
+            uint32_t hash = 2166136261u;
+            for (const HuffmanCodeEntry& entry : codes) {
+                hash = (hash ^ entry.length) * 16777619u;
+            }
+            return hash != 0 ? hash : 1;
+        }
+    }
+
+    // Counts byte values over all samples and saves codes for every byte value
+    bool trainDictionary(const std::string& samplePath, const std::string& dictionaryFileName, unsigned maxCodeLength) {
+        vector<string> samples;
+        error_code error;
+        if (fs::is_directory(samplePath, error)) {
+            for (fs::recursive_directory_iterator it(samplePath, error), end; !error && it != end; it.increment(error)) {
+                if (it->is_regular_file(error) && !fs::equivalent(it->path(), dictionaryFileName, error)) {
+                    samples.push_back(it->path().string());
+                }
+                error.clear(); // equivalent() fails while the dictionary does not exist yet
+            }
+            if (error) {
+                cerr << "Cannot list directory: " << samplePath << " (" << error.message() << ")" << endl;
+                return false;
+            }
+        } else {
+            samples.push_back(samplePath);
+        }
+        if (samples.empty()) {
+            cerr << "No sample files in: " << samplePath << endl;
+            return false;
+        }
+
+        ByteHistogram total{};
+        ByteHistogram histogram;
+        for (const string& sample : samples) {
+            if (!readFileHUF(sample, histogram)) {
+                return false;
+            }
+            for (size_t symbol = 0; symbol < total.size(); ++symbol) {
+                total[symbol] += histogram[symbol];
+            }
+        }
+        uint64_t sampleBytes = 0;
+        for (uint64_t& count : total) {
+            sampleBytes += count;
+            ++count; // Every byte value gets a code, so any input can be coded
+        }
+
+        HuffmanCodeTable codes{};
+        buildCodeTable(total, min(max(maxCodeLength, MIN_CODE_LENGTH_LIMIT), MAX_CODE_LENGTH_LIMIT), codes);
+
+        ofstream outFile(dictionaryFileName, ios::binary);
+        if (!outFile) {
+            cerr << "Cannot create file: " << dictionaryFileName << endl;
+            return false;
+        }
+        outFile.write(DICTIONARY_MAGIC, sizeof(DICTIONARY_MAGIC));
+        outFile.put(static_cast<char>(DICTIONARY_VERSION));
+        for (const HuffmanCodeEntry& entry : codes) {
+            outFile.put(static_cast<char>(entry.length));
+        }
+        outFile.close();
+        logger::log(LogLevel::Info) << "Trained dictionary " << hex << dictionaryId(codes) << dec << " on " << samples.size()
+                                    << " file(s), " << sampleBytes << " byte(s).\n";
+        if (!outFile) {
+            cerr << "Cannot write file: " << dictionaryFileName << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Reads and checks the code lengths, then builds the codes and decoder once for all blocks
+    bool loadDictionary(const std::string& dictionaryFileName, Dictionary& dictionary) {
+        ifstream inFile(dictionaryFileName, ios::binary);
+        if (!inFile) {
+            cerr << "Cannot open file: " << dictionaryFileName << endl;
+            return false;
+        }
+        vector<unsigned char> data((istreambuf_iterator<char>(inFile)), istreambuf_iterator<char>());
+        if (data.size() != DICTIONARY_FILE_SIZE || !equal(DICTIONARY_MAGIC, DICTIONARY_MAGIC + sizeof(DICTIONARY_MAGIC), data.begin())
+            || data[sizeof(DICTIONARY_MAGIC)] != DICTIONARY_VERSION) {
+            cerr << "Not a dictionary file: " << dictionaryFileName << endl;
+            return false;
+        }
+
+        const unsigned char* lengths = data.data() + sizeof(DICTIONARY_MAGIC) + 1;
+        for (size_t symbol = 0; symbol < dictionary.codes.size(); ++symbol) {
+            if (lengths[symbol] == 0 || lengths[symbol] > MAX_CODE_LENGTH_LIMIT) {
+                cerr << "Corrupt dictionary file: " << dictionaryFileName << endl;
+                return false;
+            }
+            dictionary.codes[symbol].length = lengths[symbol];
+        }
+        if (!buildCanonicalCodes(dictionary.codes) || !dictionary.decodeTable.build(dictionary.codes)) {
+            cerr << "Corrupt dictionary file: " << dictionaryFileName << endl;
+            return false;
+        }
+        dictionary.id = dictionaryId(dictionary.codes);
+        return true;
+    }
+}
@@ -1,49 +1,357 @@
 #include "fileHandles.h"
+#include "cpuFeatures.h"
+#include "logger.h"
 
 #include <iostream>
 #include <fstream>
 #include <algorithm>
 #include <filesystem>
-#include <map>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef CPU_FEATURES_X86
+#include <immintrin.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
 namespace fileHandles {
-    map<char, unsigned int> frequency_map; // Map to store the frequency of each character in the file
 
-    // Checks if a file exists at the given path
+    const char STANDARD_STREAM[] = "-";
+    const size_t READ_CHUNK_SIZE = 1 << 20; // Largest single read() issued for unmapped input
+    const size_t HISTOGRAM_CHUNK_SIZE = size_t(1) << 30;      // Keeps every 32-bit bank counter below overflow
+    const size_t PARALLEL_HISTOGRAM_MIN_SLICE = size_t(1) << 22; // Smallest slice worth a thread of its own
+    const size_t RUN_SAMPLES = 32;          // Vectors tested before the histogram turns on run detection
+    const size_t RUN_SAMPLE_THRESHOLD = 2;  // Uniform samples needed; text rarely has even one
+
+    using HistogramBanks = uint32_t[4][256];
+
+    // Counts eight bytes from one load, spreading them over the four banks
+    inline void countWord(const unsigned char* data, HistogramBanks& banks) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        banks[0][word & 0xFF]++;
+        banks[1][(word >> 8) & 0xFF]++;
+        banks[2][(word >> 16) & 0xFF]++;
+        banks[3][(word >> 24) & 0xFF]++;
+        banks[0][(word >> 32) & 0xFF]++;
+        banks[1][(word >> 40) & 0xFF]++;
+        banks[2][(word >> 48) & 0xFF]++;
+        banks[3][word >> 56]++;
+    }
+
+    // Detects a vector of one repeated value, which is then counted with a single add; scalar code does not look
+    template <CpuLevel level>
+    struct RunCheck {
+        static constexpr size_t WIDTH = 8;
+        static bool uniform(const unsigned char*) { return false; }
+    };
+
+#ifdef CPU_FEATURES_X86
+    template <>
+    struct RunCheck<CpuLevel::Sse42> {
+        static constexpr size_t WIDTH = 16;
+        __attribute__((target("sse4.2")))
+        static bool uniform(const unsigned char* data) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(data[0])))) == 0xFFFF;
+        }
+    };
+
+    template <>
+    struct RunCheck<CpuLevel::Avx2> {
+        static constexpr size_t WIDTH = 32;
+        __attribute__((target("avx2")))
+        static bool uniform(const unsigned char* data) {
+            __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+            return _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(static_cast<char>(data[0])))) == -1;
+        }
+    };
+#endif
+
+    // Counts one vector width at a time: a run of one value with a single add, anything else eight bytes per load
+    template <CpuLevel level>
+    CPU_KERNEL void countBytesKernel(const unsigned char* data, size_t size, HistogramBanks& banks) {
+        using Run = RunCheck<level>;
+        size_t i = 0;
+        for (; i + Run::WIDTH <= size; i += Run::WIDTH) {
+            if (Run::uniform(data + i)) {
+                banks[0][data[i]] += Run::WIDTH;
+                continue;
+            }
+            for (size_t word = 0; word < Run::WIDTH; word += 8) {
+                countWord(data + i + word, banks);
+            }
+        }
+        for (; i < size; ++i) {
+            banks[0][data[i]]++;
+        }
+    }
+
+    void countBytesScalar(const unsigned char* data, size_t size, HistogramBanks& banks) {
+        countBytesKernel<CpuLevel::Scalar>(data, size, banks);
+    }
+
+#ifdef CPU_FEATURES_X86
+    __attribute__((target("sse4.2")))
+    void countBytesSse42(const unsigned char* data, size_t size, HistogramBanks& banks) {
+        countBytesKernel<CpuLevel::Sse42>(data, size, banks);
+    }
+
+    __attribute__((target("avx2,bmi2")))
+    void countBytesAvx2(const unsigned char* data, size_t size, HistogramBanks& banks) {
+        countBytesKernel<CpuLevel::Avx2>(data, size, banks);
+    }
+#endif
+
+    // Tests evenly spaced vectors for a single repeated value. The run check costs a compare per vector, which is
+    // slower than the scalar loop on data without runs, so it is only worth turning on when the sample finds some
+    template <CpuLevel level>
+    bool sampleShowsRuns(const unsigned char* data, size_t size) {
+        using Run = RunCheck<level>;
+        if (size < RUN_SAMPLES * Run::WIDTH) {
+            return false;
+        }
+        size_t stride = size / RUN_SAMPLES;
+        size_t uniform = 0;
+        for (size_t sample = 0; sample < RUN_SAMPLES; ++sample) {
+            uniform += Run::uniform(data + sample * stride);
+        }
+        return uniform >= RUN_SAMPLE_THRESHOLD;
+    }
+
+    // Counts in chunks small enough for 32-bit banks, then folds the banks into the histogram
+    void countBytes(const unsigned char* data, size_t size, ByteHistogram& histogram) {
+        void (*kernel)(const unsigned char*, size_t, HistogramBanks&) = countBytesScalar;
+#ifdef CPU_FEATURES_X86
+        switch (cpuLevel()) {
+        case CpuLevel::Scalar: break;
+        case CpuLevel::Sse42: kernel = sampleShowsRuns<CpuLevel::Sse42>(data, size) ? countBytesSse42 : countBytesScalar; break;
+        case CpuLevel::Avx2: kernel = sampleShowsRuns<CpuLevel::Avx2>(data, size) ? countBytesAvx2 : countBytesScalar; break;
+        }
+#endif
+        alignas(64) HistogramBanks banks;
+        while (size > 0) {
+            size_t count = min(size, HISTOGRAM_CHUNK_SIZE);
+            memset(banks, 0, sizeof(banks));
+            kernel(data, count, banks);
+            for (size_t symbol = 0; symbol < 256; ++symbol) {
+                histogram[symbol] += uint64_t(banks[0][symbol]) + banks[1][symbol] + banks[2][symbol] + banks[3][symbol];
+            }
+            data += count;
+            size -= count;
+        }
+    }
+
+    // Splits the buffer into one slice per thread and sums the per-slice histograms
+    void countBytesParallel(const unsigned char* data, size_t size, ByteHistogram& histogram, unsigned threads) {
+        if (threads == 0) {
+            threads = max(thread::hardware_concurrency(), 1u);
+        }
+        threads = static_cast<unsigned>(min<size_t>(threads, max<size_t>(size / PARALLEL_HISTOGRAM_MIN_SLICE, 1)));
+        if (threads <= 1) {
+            countBytes(data, size, histogram);
+            return;
+        }
+
+        vector<ByteHistogram> partial(threads, ByteHistogram{});
+        vector<thread> workers;
+        size_t slice = size / threads;
+        for (unsigned t = 0; t < threads; ++t) {
+            size_t begin = t * slice;
+            size_t count = t + 1 == threads ? size - begin : slice;
+            workers.emplace_back([&partial, data, begin, count, t]() {
+                countBytes(data + begin, count, partial[t]);
+            });
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        for (const ByteHistogram& counts : partial) {
+            for (size_t symbol = 0; symbol < 256; ++symbol) {
+                histogram[symbol] += counts[symbol];
+            }
+        }
+    }
+
+    // Checks if a file exists at the given path; standard input and output always do
     bool fileExists(const filesystem::path& path) {
-        if (!filesystem::exists(path)) {
-            cout << "File does not exist: " << path << endl;
+        if (path != STANDARD_STREAM && !filesystem::exists(path)) {
+            logger::log(logger::LogLevel::Debug) << "File does not exist: " << path << endl;
             return false;
         }
         return true;
     }
     
-    // Reads a file and builds a frequency map of its characters
-    void readFileHUF(const std::string& filePath) {
-        cout << "Reading file: " << filePath << endl;
-        ifstream inFile(filePath, ios::binary); // Open file in binary mode
-        if (!inFile) {
+    // Reads a file and builds a frequency table of its bytes
+    bool readFileHUF(const std::string& filePath, ByteHistogram& histogram) {
+        logger::log(logger::LogLevel::Info) << "Reading file: " << filePath << endl;
+        InputFile inFile;
+        if (!inFile.open(filePath, AccessPattern::Sequential)) {
             cerr << "Cannot open file: " << filePath << endl;
-            return;
+            return false;
         }
 
-        frequency_map.clear(); // Clear the frequency map before reading
+        histogram.fill(0); // Clear the frequency table before reading
 
-        char tempChar;
-        // Read the file character by character
-        while (inFile.get(tempChar)) {
-            frequency_map[tempChar]++; // Increment the frequency of the character
-            cout << tempChar; // Print the character (optional, for debugging)
+        vector<unsigned char> buffer;
+        if (inFile.isMapped()) {
+            countBytesParallel(inFile.next(inFile.size(), buffer).data, inFile.size(), histogram); // Count the whole mapping at once
+        } else {
+            for (ByteSpan span = inFile.next(READ_CHUNK_SIZE, buffer); span.size > 0; span = inFile.next(READ_CHUNK_SIZE, buffer)) {
+                countBytes(span.data, span.size, histogram);
+            }
         }
 
         // Print the frequency of each character
-        for (const auto& pair : frequency_map) {
-            cout << pair.first << " " << pair.second << endl;
+        if (logger::enabled(logger::LogLevel::Debug)) {
+            for (size_t symbol = 0; symbol < histogram.size(); ++symbol) {
+                if (histogram[symbol] > 0) {
+                    logger::log(logger::LogLevel::Debug) << symbol << " " << histogram[symbol] << "\n";
+                }
+            }
+        }
+
+        logger::log(logger::LogLevel::Info) << "File successfully read.\n";
+        return !inFile.failed();
+    }
+
+    InputFile::~InputFile() {
+        if (mapping) {
+            munmap(const_cast<unsigned char*>(mapping), fileSize);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    // Opens the file and maps it if it is a non-empty regular file
+    bool InputFile::open(const std::string& path, AccessPattern pattern) {
+        fd = path == STANDARD_STREAM ? ::dup(STDIN_FILENO) : ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+            regular = true;
+            fileSize = static_cast<uint64_t>(info.st_size);
+        }
+        if (regular && fileSize > 0) {
+            void* address = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                mapping = static_cast<const unsigned char*>(address);
+                if (pattern == AccessPattern::Sequential) {
+                    madvise(address, fileSize, MADV_SEQUENTIAL); // Aggressive read-ahead, early reclaim
+                    madvise(address, fileSize, MADV_WILLNEED);   // Start reading now
+                } else {
+                    madvise(address, fileSize, MADV_RANDOM);     // Only fault in the ranges asked for
+                }
+            }
+        }
+        if (regular && !mapping) {
+            posix_fadvise(fd, 0, 0, pattern == AccessPattern::Sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+        }
+        return true;
+    }
+
+    bool InputFile::isMapped() const {
+        return mapping != nullptr;
+    }
+
+    bool InputFile::isSeekable() const {
+        return regular;
+    }
+
+    uint64_t InputFile::size() const {
+        return fileSize;
+    }
+
+    bool InputFile::failed() const {
+        return error;
+    }
+
+    // Returns a span into the mapping, or fills the buffer with large read() calls
+    ByteSpan InputFile::next(size_t maxBytes, std::vector<unsigned char>& buffer) {
+        ByteSpan span;
+        if (mapping) {
+            span.data = mapping + position;
+            span.size = static_cast<size_t>(min<uint64_t>(maxBytes, fileSize - position));
+            position += span.size;
+            return span;
+        }
+
+        buffer.resize(maxBytes);
+        size_t filled = 0;
+        while (filled < maxBytes) {
+            ssize_t count = ::read(fd, buffer.data() + filled, min(maxBytes - filled, READ_CHUNK_SIZE));
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error = true;
+                break;
+            }
+            if (count == 0) {
+                break; // End of input
+            }
+            filled += static_cast<size_t>(count);
+        }
+        position += filled;
+        span.data = buffer.data();
+        span.size = filled;
+        return span;
+    }
+
+    // Returns a span into the mapping, or fills the buffer with pread() calls
+    bool InputFile::readAt(uint64_t offset, size_t length, std::vector<unsigned char>& buffer, ByteSpan& out) {
+        if (!regular || offset > fileSize || length > fileSize - offset) {
+            return false;
+        }
+        if (mapping) {
+            out.data = mapping + offset;
+            out.size = length;
+            return true;
+        }
+
+        buffer.resize(length);
+        size_t filled = 0;
+        while (filled < length) {
+            ssize_t count = ::pread(fd, buffer.data() + filled, min(length - filled, READ_CHUNK_SIZE), static_cast<off_t>(offset + filled));
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                error = true;
+                return false;
+            }
+            filled += static_cast<size_t>(count);
         }
+        out.data = buffer.data();
+        out.size = length;
+        return true;
+    }
 
-        inFile.close();
-        cout << "File successfully read.\n";
+    // Asks for the whole range at once, so the disk can work on it in parallel, then faults each page in here
+    void InputFile::prefetch(const ByteSpan& span) const {
+        if (!mapping || span.size == 0 || span.data < mapping || span.data >= mapping + fileSize) {
+            return;
+        }
+        static const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        uintptr_t begin = reinterpret_cast<uintptr_t>(span.data) & ~(pageSize - 1);
+        uintptr_t end = reinterpret_cast<uintptr_t>(span.data) + span.size;
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+        unsigned char sum = 0;
+        for (uintptr_t page = reinterpret_cast<uintptr_t>(span.data); page < end; page = (page & ~(pageSize - 1)) + pageSize) {
+            sum ^= *reinterpret_cast<const volatile unsigned char*>(page);
+        }
+        (void)sum;
     }
-}
\ No newline at end of file
+}
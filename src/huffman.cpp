@@ -1,17 +1,19 @@
 /**
  * @file huffman.cpp
- * @brief Implementation of the MinHeap class and the HuffmanNode class.
- * 
- * This file contains the implementation of the MinHeap class, which represents a min-heap data structure,
- * and the HuffmanNode class, which represents a node in a Huffman tree.
- * The MinHeap class is used to store HuffmanNode objects and perform operations such as insertion, extraction,
- * and checking if the heap is empty.
- * The HuffmanNode class represents a node in a Huffman tree and contains methods for getting the left and right
- * child nodes, getting the data and frequency of the node, printing the tree, encoding and decoding the data,
- * and assigning binary codes to characters.
- * 
+ * @brief Huffman code construction, canonical codes and the table-driven coders.
+ *
+ * Code lengths come from FlatHuffmanTree, which sorts the byte counts and merges
+ * nodes from two queues instead of a heap, or from package-merge when the lengths
+ * must stay within a limit. buildCanonicalCodes turns lengths into canonical codes.
+ * HuffmanDecodeTable decodes one or four interleaved streams with multi-level
+ * lookup tables. The encode and decode loops are kernels compiled once per CPU
+ * level (see cpuFeatures.h) and picked at run time. The pointer-based HuffmanNode
+ * tree is kept for the tree decoder (--decoder=tree), along with its MinHeap.
  */
 #include "huffman.h"
+#include "bitstream.h"
+#include "cpuFeatures.h"
+#include "logger.h"
 #include <algorithm>
 #include <iostream>
 #include <bitset> // Add this include for bitset
@@ -55,36 +57,573 @@ void HuffmanNode::encode(const std::string& code, std::map<char, std::string>& H
         return;
     }
     if (!huffmanPtr->getLeft() && !huffmanPtr->getRight()) {
-        std::cout << "Assigning " << huffmanPtr->getData() << " the code " << code << "\n";
+        logger::log(logger::LogLevel::Debug) << "Assigning " << huffmanPtr->getData() << " the code " << code << "\n";
         HuffmanCode[huffmanPtr->getData()] = code;
     }
     if (huffmanPtr->getLeft()) {
-        std::cout << "Going left\n";
         huffmanPtr->getLeft()->encode(code + "0", HuffmanCode);
     }
     if (huffmanPtr->getRight()) {
-        std::cout << "Going right\n";
         huffmanPtr->getRight()->encode(code + "1", HuffmanCode);
     }
 }
 
 // Traverse the tree and decode the binary code to the original string
-void HuffmanNode::decode(HuffmanNode* huffmanPtr, std::ifstream& infile, std::ofstream& outfile) {
-    char byte;
-    while (infile.get(byte)) {
-        std::bitset<8> bits(byte); 
-        for (int i = 7; i >= 0; --i) {
+bool HuffmanNode::decode(const unsigned char* data, size_t size, uint64_t count, std::string& out) {
+    HuffmanNode* huffmanPtr = this;
+    out.reserve(out.size() + count);
+    for (size_t pos = 0; pos < size && count > 0; ++pos) {
+        std::bitset<8> bits(data[pos]); 
+        for (int i = 7; i >= 0 && count > 0; --i) {
+            huffmanPtr = bits[i] ? huffmanPtr->getRight() : huffmanPtr->getLeft();
+            if (!huffmanPtr) {
+                return false; // The bits do not lead to any character
+            }
             if (!huffmanPtr->getLeft() && !huffmanPtr->getRight()) {
-                outfile.put(huffmanPtr->getData());
+                out.push_back(huffmanPtr->getData());
                 huffmanPtr = this;
+                --count;
             }
-            huffmanPtr = bits[i] ? huffmanPtr->getRight() : huffmanPtr->getLeft();
         }
     }
+    return count == 0;
+}
 
-    if (!huffmanPtr->getLeft() && !huffmanPtr->getRight()) {
-        outfile.put(huffmanPtr->getData());
+// Rebuild a tree by following each code from the root and creating nodes on the way
+HuffmanNode* HuffmanNode::fromCodes(const HuffmanCodeTable& codes) {
+    HuffmanNode* root = new HuffmanNode();
+    for (unsigned symbol = 0; symbol < codes.size(); ++symbol) {
+        const HuffmanCodeEntry& entry = codes[symbol];
+        HuffmanNode* node = root;
+        for (int bit = entry.length - 1; bit >= 0; --bit) {
+            HuffmanNode*& child = ((entry.code >> bit) & 1) ? node->right : node->left;
+            if (!child) {
+                child = new HuffmanNode();
+            }
+            node = child;
+        }
+        if (entry.length > 0) {
+            node->data = static_cast<char>(symbol);
+        }
+    }
+    return root;
+}
+
+// Recursively traverse the tree and store an integer code and length for each character
+void HuffmanNode::assignCodes(uint64_t code, unsigned length, HuffmanCodeTable& table) {
+    if (!left && !right) {
+        table[static_cast<unsigned char>(data)] = {code, static_cast<unsigned char>(length)};
+        return;
+    }
+    if (left) {
+        left->assignCodes(code << 1, length + 1, table);
+    }
+    if (right) {
+        right->assignCodes((code << 1) | 1, length + 1, table);
+    }
+}
+
+// Assign canonical codes: count codes per length, then hand out consecutive values per length
+bool buildCanonicalCodes(HuffmanCodeTable& table) {
+    uint64_t lengthCount[MAX_HUFFMAN_CODE_LENGTH + 1] = {};
+    for (const HuffmanCodeEntry& entry : table) {
+        if (entry.length > MAX_HUFFMAN_CODE_LENGTH) {
+            return false;
+        }
+        lengthCount[entry.length]++;
+    }
+    lengthCount[0] = 0;
+
+    uint64_t nextCode[MAX_HUFFMAN_CODE_LENGTH + 1] = {};
+    uint64_t code = 0;
+    for (unsigned length = 1; length <= MAX_HUFFMAN_CODE_LENGTH; ++length) {
+        code = (code + lengthCount[length - 1]) << 1;
+        if (code + lengthCount[length] > (uint64_t(1) << length)) {
+            return false; // More codes of this length than the code space allows
+        }
+        nextCode[length] = code;
+    }
+
+    for (HuffmanCodeEntry& entry : table) {
+        entry.code = entry.length > 0 ? nextCode[entry.length]++ : 0;
+    }
+    return true;
+}
+
+// Build the primary lookup table (and any secondary tables) from the code table
+bool HuffmanDecodeTable::build(const HuffmanCodeTable& codes) {
+    entries.clear();
+    symbols.clear(); // Both keep their capacity, so rebuilding a table does not allocate
+    for (unsigned symbol = 0; symbol < codes.size(); ++symbol) {
+        if (codes[symbol].length > 0) {
+            symbols.emplace_back(static_cast<unsigned char>(symbol), codes[symbol]);
+        }
+    }
+    if (symbols.empty()) {
+        return false;
+    }
+    longestCode = 0;
+    for (const auto& symbol : symbols) {
+        longestCode = std::max<unsigned>(longestCode, symbol.second.length);
+    }
+
+    entries.reserve(size_t(1) << PRIMARY_BITS);
+    buildLevel(symbols, 0, PRIMARY_BITS);
+    return true;
+}
+
+// Fill one table level for codes sharing a prefix of `consumed` bits; returns the level's offset
+size_t HuffmanDecodeTable::buildLevel(std::vector<std::pair<unsigned char, HuffmanCodeEntry>>& symbols, unsigned consumed, unsigned bits) {
+    size_t offset = entries.size();
+    entries.resize(offset + (size_t(1) << bits), 0);
+
+    std::map<uint32_t, std::vector<std::pair<unsigned char, HuffmanCodeEntry>>> longer; // Codes continuing past this level
+    for (const auto& symbol : symbols) {
+        unsigned remaining = symbol.second.length - consumed;
+        if (remaining <= bits) {
+            // Every index starting with the code maps to the symbol
+            uint32_t first = static_cast<uint32_t>(symbol.second.code & ((uint64_t(1) << remaining) - 1)) << (bits - remaining);
+            uint32_t count = uint32_t(1) << (bits - remaining);
+            for (uint32_t i = 0; i < count; ++i) {
+                entries[offset + first + i] = (uint32_t(symbol.first) << 10) | remaining;
+            }
+        } else {
+            uint32_t index = static_cast<uint32_t>(symbol.second.code >> (remaining - bits)) & ((uint32_t(1) << bits) - 1);
+            longer[index].push_back(symbol);
+        }
+    }
+
+    for (auto& group : longer) {
+        unsigned maxLength = 0;
+        for (const auto& symbol : group.second) {
+            maxLength = std::max<unsigned>(maxLength, symbol.second.length);
+        }
+        unsigned subBits = std::min(maxLength - consumed - bits, SECONDARY_BITS);
+        size_t subOffset = buildLevel(group.second, consumed + bits, subBits);
+        entries[offset + group.first] = (static_cast<uint32_t>(subOffset) << 10) | (subBits << 5) | bits;
+    }
+    return offset;
+}
+
+// Decode the bit stream with one table probe per symbol (plus one per secondary level). The encode and decode loops
+// are kernels compiled once per CPU level; the AVX2 build lets the compiler use the BMI2 shifts and masks
+namespace {
+    // Read position in one bit stream
+    struct BitCursor {
+        const unsigned char* data = nullptr;
+        size_t size = 0;
+        size_t pos = 0;            // Next byte to load
+        uint64_t bitBuffer = 0;    // Unconsumed bits, left-aligned
+        unsigned bitCount = 0;     // Number of valid bits in bitBuffer
+        uint64_t bitsLeft = 0;     // Bits not yet consumed, including those still in memory
+
+        BitCursor() = default;
+        BitCursor(const unsigned char* data, size_t size) : data(data), size(size), bitsLeft(uint64_t(size) * 8) {}
+
+        // Tops the buffer up to at least 56 bits, or with whatever is left near the end
+        void refill() {
+            if (pos + 8 <= size) {
+                bitBuffer |= loadBigEndian64(data + pos) >> bitCount;
+                pos += (63 - bitCount) >> 3;
+                bitCount |= 56;
+            } else {
+                while (bitCount <= 56 && pos < size) {
+                    bitBuffer |= uint64_t(data[pos++]) << (56 - bitCount);
+                    bitCount += 8;
+                }
+            }
+        }
+    };
+
+    // Ors codes into a left-aligned accumulator and stores all eight bytes of it after every perStore symbols, then
+    // moves on by the whole bytes filled. perStore codes of the longest length may add at most 56 bits, so with the
+    // partial byte carried over fewer than 64 are pending and the shift stays below 64; dest needs eight bytes of
+    // slack. Returns the bytes written, the last one padded with zeros
+    CPU_KERNEL size_t encodeSymbolsKernel(const unsigned char* data, size_t size, const HuffmanCodeTable& codes, unsigned perStore, unsigned char* dest) {
+        unsigned char* next = dest;
+        uint64_t accumulator = 0;
+        unsigned bitCount = 0; // At most 7 after each store
+        for (size_t i = 0; i < size;) {
+            size_t end = size - i < perStore ? size : i + perStore;
+            for (; i < end; ++i) {
+                const HuffmanCodeEntry& entry = codes[data[i]];
+                accumulator |= entry.code << (64 - bitCount - entry.length);
+                bitCount += entry.length;
+            }
+            storeBigEndian64(next, accumulator);
+            next += bitCount >> 3;
+            accumulator <<= bitCount & ~7u;
+            bitCount &= 7;
+        }
+        return static_cast<size_t>(next - dest) + (bitCount + 7) / 8;
+    }
+
+    // Decodes count symbols one at a time, following secondary tables for long codes
+    CPU_KERNEL bool decodeSymbolsKernel(const uint32_t* entries, BitCursor& cursor, uint64_t count, char* dest) {
+        const unsigned primaryBits = HuffmanDecodeTable::PRIMARY_BITS;
+        for (uint64_t i = 0; i < count; ++i) {
+            cursor.refill();
+
+            uint64_t peek = cursor.bitBuffer;
+            size_t offset = 0;
+            unsigned bits = primaryBits;
+            unsigned used = 0;
+            uint32_t entry;
+            for (;;) {
+                entry = entries[offset + (peek >> (64 - bits))];
+                unsigned length = entry & 31;
+                unsigned subBits = (entry >> 5) & 31;
+                if (length == 0) {
+                    return false; // No code starts with these bits
+                }
+                used += length;
+                if (subBits == 0) {
+                    break;
+                }
+                peek <<= length;
+                offset = entry >> 10;
+                bits = subBits;
+            }
+
+            if (used > cursor.bitsLeft) {
+                return false; // The stream ended in the middle of a code
+            }
+            dest[i] = static_cast<char>(entry >> 10);
+            cursor.bitBuffer <<= used;
+            cursor.bitCount -= used;
+            cursor.bitsLeft -= used;
+        }
+        return true;
+    }
+
+    // While every stream has a full word left, refills all four and then decodes perRefill symbols from each in turn;
+    // every code must resolve in one primary lookup. Advances the cursors, destinations and remaining counts past the
+    // symbols decoded; returns false on a bit pattern with no code
+    CPU_KERNEL bool decodeFourKernel(const uint32_t* table, unsigned perRefill, BitCursor cursors[4], char* dests[4], uint64_t remaining[4]) {
+        const unsigned primaryBits = HuffmanDecodeTable::PRIMARY_BITS;
+        uint64_t steps = UINT64_MAX; // Rounds every stream has enough symbols for
+        for (unsigned s = 0; s < 4; ++s) {
+            steps = std::min<uint64_t>(steps, remaining[s] / perRefill);
+        }
+
+        // Stream state lives in locals: stores through char* could otherwise alias it and force reloads
+        const unsigned char* source[4];
+        size_t pos[4];
+        uint64_t buffer[4];
+        unsigned count[4];
+        char* dest[4];
+        for (unsigned s = 0; s < 4; ++s) {
+            source[s] = cursors[s].data;
+            pos[s] = cursors[s].pos;
+            buffer[s] = cursors[s].bitBuffer;
+            count[s] = cursors[s].bitCount;
+            dest[s] = dests[s];
+        }
+        unsigned invalid = 0;
+        size_t written = 0; // Symbols decoded so far from each stream
+        size_t limit[4]; // A refill reads a whole word, so it may start at most here
+        for (unsigned s = 0; s < 4; ++s) {
+            if (cursors[s].size < 8) {
+                steps = 0;
+            }
+            limit[s] = cursors[s].size - 8;
+        }
+        for (uint64_t step = 0; step < steps; ++step) {
+            if (pos[0] > limit[0] || pos[1] > limit[1] || pos[2] > limit[2] || pos[3] > limit[3]) {
+                break;
+            }
+            for (unsigned s = 0; s < 4; ++s) {
+                buffer[s] |= loadBigEndian64(source[s] + pos[s]) >> count[s];
+                pos[s] += (63 - count[s]) >> 3;
+                count[s] |= 56;
+            }
+            for (unsigned k = 0; k < perRefill; ++k, ++written) {
+                for (unsigned s = 0; s < 4; ++s) {
+                    uint32_t entry = table[buffer[s] >> (64 - primaryBits)];
+                    unsigned length = entry & 31;
+                    invalid |= length == 0;
+                    dest[s][written] = static_cast<char>(entry >> 10);
+                    buffer[s] <<= length;
+                    count[s] -= length;
+                }
+            }
+        }
+        if (invalid) {
+            return false;
+        }
+        for (unsigned s = 0; s < 4; ++s) {
+            BitCursor& cursor = cursors[s];
+            cursor.pos = pos[s];
+            cursor.bitBuffer = buffer[s];
+            cursor.bitCount = count[s];
+            cursor.bitsLeft = uint64_t(cursor.size) * 8 - (uint64_t(cursor.pos) * 8 - cursor.bitCount);
+            remaining[s] -= written;
+            dests[s] = dest[s] + written;
+        }
+        return true;
+    }
+
+    // Entry points of the kernels compiled for one CPU level
+    struct HuffmanKernels {
+        size_t (*encodeSymbols)(const unsigned char* data, size_t size, const HuffmanCodeTable& codes, unsigned perStore, unsigned char* dest);
+        bool (*decodeSymbols)(const uint32_t* entries, BitCursor& cursor, uint64_t count, char* dest);
+        bool (*decodeFour)(const uint32_t* table, unsigned perRefill, BitCursor cursors[4], char* dests[4], uint64_t remaining[4]);
+    };
+
+    size_t encodeSymbolsScalar(const unsigned char* data, size_t size, const HuffmanCodeTable& codes, unsigned perStore, unsigned char* dest) {
+        return encodeSymbolsKernel(data, size, codes, perStore, dest);
+    }
+
+    bool decodeSymbolsScalar(const uint32_t* entries, BitCursor& cursor, uint64_t count, char* dest) {
+        return decodeSymbolsKernel(entries, cursor, count, dest);
+    }
+
+    bool decodeFourScalar(const uint32_t* table, unsigned perRefill, BitCursor cursors[4], char* dests[4], uint64_t remaining[4]) {
+        return decodeFourKernel(table, perRefill, cursors, dests, remaining);
+    }
+
+    const HuffmanKernels scalarKernels = {encodeSymbolsScalar, decodeSymbolsScalar, decodeFourScalar};
+
+#ifdef CPU_FEATURES_X86
+    __attribute__((target("avx2,bmi,bmi2")))
+    size_t encodeSymbolsAvx2(const unsigned char* data, size_t size, const HuffmanCodeTable& codes, unsigned perStore, unsigned char* dest) {
+        return encodeSymbolsKernel(data, size, codes, perStore, dest);
+    }
+
+    __attribute__((target("avx2,bmi,bmi2")))
+    bool decodeSymbolsAvx2(const uint32_t* entries, BitCursor& cursor, uint64_t count, char* dest) {
+        return decodeSymbolsKernel(entries, cursor, count, dest);
+    }
+
+    __attribute__((target("avx2,bmi,bmi2")))
+    bool decodeFourAvx2(const uint32_t* table, unsigned perRefill, BitCursor cursors[4], char* dests[4], uint64_t remaining[4]) {
+        return decodeFourKernel(table, perRefill, cursors, dests, remaining);
+    }
+
+    const HuffmanKernels avx2Kernels = {encodeSymbolsAvx2, decodeSymbolsAvx2, decodeFourAvx2};
+#endif
+
+    // Bit-serial coding has no use for the SSE4.2 instructions, so that level runs the scalar build
+    const HuffmanKernels& kernels() {
+#ifdef CPU_FEATURES_X86
+        if (cpuLevel() >= CpuLevel::Avx2) {
+            return avx2Kernels;
+        }
+#endif
+        return scalarKernels;
+    }
+}
+
+void encodeHuffman(const unsigned char* data, size_t size, const HuffmanCodeTable& codes, std::vector<unsigned char>& out) {
+    unsigned longest = 0;
+    for (const HuffmanCodeEntry& entry : codes) {
+        longest = std::max<unsigned>(longest, entry.length);
+    }
+    size_t first = out.size();
+    out.resize(first + (uint64_t(size) * longest + 7) / 8 + 8); // Eight bytes of slack for the last whole-word store
+    size_t written = kernels().encodeSymbols(data, size, codes, MAX_HUFFMAN_CODE_LENGTH / std::max(longest, 1u), out.data() + first);
+    out.resize(first + written);
+}
+
+bool HuffmanDecodeTable::decode(const unsigned char* data, size_t size, uint64_t count, std::string& out) const {
+    if (count == 0) {
+        return true;
+    }
+    if (entries.empty()) {
+        return false;
+    }
+
+    BitCursor cursor(data, size);
+    size_t first = out.size();
+    out.resize(first + count);
+    return kernels().decodeSymbols(entries.data(), cursor, count, &out[first]);
+}
+
+// Refills all four streams and then decodes several symbols from each in turn; the four streams are independent,
+// so their lookups overlap instead of waiting on one another
+bool HuffmanDecodeTable::decodeFour(const unsigned char* const streams[4], const size_t sizes[4], uint64_t count, std::string& out) const {
+    if (count == 0) {
+        return true;
+    }
+    if (entries.empty()) {
+        return false;
+    }
+
+    size_t first = out.size();
+    out.resize(first + count);
+    BitCursor cursors[4];
+    char* dests[4];
+    uint64_t remaining[4];
+    char* next = &out[first];
+    for (unsigned s = 0; s < 4; ++s) {
+        cursors[s] = BitCursor(streams[s], sizes[s]);
+        remaining[s] = interleavedStreamSymbols(count, s);
+        dests[s] = next;
+        next += remaining[s];
+    }
+
+    const HuffmanKernels& kernel = kernels();
+    // Every code resolves in one lookup, and a refill leaves at least 56 bits: enough for 56 / longestCode codes
+    if (longestCode <= PRIMARY_BITS && !kernel.decodeFour(entries.data(), 56 / longestCode, cursors, dests, remaining)) {
+        return false;
+    }
+    for (unsigned s = 0; s < 4; ++s) { // The last few symbols of each stream, and long codes
+        if (!kernel.decodeSymbols(entries.data(), cursors[s], remaining[s], dests[s])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sort the leaves, then repeatedly merge the two smallest front nodes of the leaf and internal queues
+unsigned FlatHuffmanTree::build(const std::array<uint64_t, MAX_SYMBOLS>& counts) {
+    leafCount = 0;
+    for (unsigned symbol = 0; symbol < MAX_SYMBOLS; ++symbol) {
+        if (counts[symbol] > 0) {
+            nodes[leafCount++] = {counts[symbol], -1, static_cast<unsigned char>(symbol)};
+        }
+    }
+    std::sort(nodes.begin(), nodes.begin() + leafCount, [](const Node& l, const Node& r) {
+        return l.frequency != r.frequency ? l.frequency < r.frequency : l.symbol < r.symbol;
+    });
+
+    nodeCount = leafCount;
+    unsigned nextLeaf = 0;          // Front of the leaf queue
+    unsigned nextInternal = leafCount; // Front of the internal queue
+    auto takeSmallest = [&]() {
+        // Prefer the leaf on ties, which keeps the tree shallow
+        if (nextLeaf < leafCount && (nextInternal == nodeCount || nodes[nextLeaf].frequency <= nodes[nextInternal].frequency)) {
+            return nextLeaf++;
+        }
+        return nextInternal++;
+    };
+    while (leafCount > 1 && nodeCount < 2 * leafCount - 1) {
+        unsigned left = takeSmallest();
+        unsigned right = takeSmallest();
+        nodes[nodeCount] = {nodes[left].frequency + nodes[right].frequency, -1, 0};
+        nodes[left].parent = static_cast<int16_t>(nodeCount);
+        nodes[right].parent = static_cast<int16_t>(nodeCount);
+        ++nodeCount;
+    }
+    return leafCount;
+}
+
+// Parents always have higher indices than their children, so depths fill in one backward pass
+void FlatHuffmanTree::codeLengths(HuffmanCodeTable& table) const {
+    for (HuffmanCodeEntry& entry : table) {
+        entry.length = 0;
+    }
+    if (leafCount == 1) {
+        table[nodes[0].symbol].length = 1; // A lone byte value still needs one bit
+        return;
+    }
+
+    unsigned char depth[MAX_NODES];
+    for (int node = static_cast<int>(nodeCount) - 1; node >= 0; --node) {
+        depth[node] = nodes[node].parent < 0 ? 0 : depth[nodes[node].parent] + 1;
+    }
+    for (unsigned leaf = 0; leaf < leafCount; ++leaf) {
+        table[nodes[leaf].symbol].length = depth[leaf];
+    }
+}
+
+// Package-merge: list d holds the leaves merged with pairs ("packages") of list d + 1; the first
+// 2n - 2 items of list 1 select how many lists each leaf appears in, which is its code length
+bool buildLengthLimitedCodeLengths(const std::array<uint64_t, 256>& counts, unsigned maxLength, HuffmanCodeTable& table) {
+    struct Leaf {
+        uint64_t weight;
+        unsigned char symbol;
+    };
+    struct Item {
+        uint64_t weight;
+        int16_t leaf;      // Leaf index, or -1 for a package
+        int16_t child;     // First of the two packaged items in the next list
+    };
+
+    for (HuffmanCodeEntry& entry : table) {
+        entry.length = 0;
+    }
+    std::array<Leaf, 256> leaves;
+    size_t n = 0;
+    for (unsigned symbol = 0; symbol < counts.size(); ++symbol) {
+        if (counts[symbol] > 0) {
+            leaves[n++] = {counts[symbol], static_cast<unsigned char>(symbol)};
+        }
+    }
+    if (n <= 2) {
+        for (size_t i = 0; i < n; ++i) {
+            table[leaves[i].symbol].length = 1;
+        }
+        return true;
+    }
+    if (maxLength == 0 || maxLength >= 64 || n > (uint64_t(1) << maxLength)) {
+        return false;
+    }
+    std::sort(leaves.begin(), leaves.begin() + n, [](const Leaf& l, const Leaf& r) {
+        return l.weight != r.weight ? l.weight < r.weight : l.symbol < r.symbol;
+    });
+
+    // Each list holds fewer than 2n items. The storage is kept per thread, so
+    // repeated calls do not allocate and concurrent calls do not share it.
+    const size_t stride = 2 * n;
+    thread_local std::vector<Item> items;
+    thread_local std::vector<size_t> listSizes;
+    thread_local std::vector<char> selected;
+    thread_local std::vector<char> deeperSelected;
+    items.resize(maxLength * stride);
+    listSizes.assign(maxLength, 0);
+    auto list = [&](unsigned depth) { return items.data() + (depth - 1) * stride; }; // List d, 1-based
+
+    // List maxLength holds only the leaves
+    for (size_t i = 0; i < n; ++i) {
+        list(maxLength)[i] = {leaves[i].weight, static_cast<int16_t>(i), -1};
+    }
+    listSizes[maxLength - 1] = n;
+    for (unsigned depth = maxLength - 1; depth >= 1; --depth) {
+        const Item* deeper = list(depth + 1);
+        Item* current = list(depth);
+        size_t size = 0;
+        size_t leaf = 0;
+        size_t pair = 0;
+        size_t pairs = listSizes[depth] / 2;
+        while (leaf < n || pair < pairs) {
+            uint64_t packageWeight = pair < pairs ? deeper[2 * pair].weight + deeper[2 * pair + 1].weight : 0;
+            if (leaf < n && (pair == pairs || leaves[leaf].weight <= packageWeight)) {
+                current[size++] = {leaves[leaf].weight, static_cast<int16_t>(leaf), -1};
+                ++leaf;
+            } else {
+                current[size++] = {packageWeight, -1, static_cast<int16_t>(2 * pair)};
+                ++pair;
+            }
+        }
+        listSizes[depth - 1] = size;
+    }
+
+    // Walk the selection down the lists, counting each selected leaf once per list
+    unsigned char lengths[256] = {};
+    selected.assign(stride, 0);
+    std::fill(selected.begin(), selected.begin() + (2 * n - 2), 1);
+    for (unsigned depth = 1; depth <= maxLength; ++depth) {
+        const Item* current = list(depth);
+        deeperSelected.assign(stride, 0);
+        for (size_t i = 0; i < listSizes[depth - 1]; ++i) {
+            if (!selected[i]) {
+                continue;
+            }
+            if (current[i].leaf >= 0) {
+                lengths[current[i].leaf]++;
+            } else {
+                deeperSelected[current[i].child] = 1;
+                deeperSelected[current[i].child + 1] = 1;
+            }
+        }
+        selected.swap(deeperSelected);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        table[leaves[i].symbol].length = lengths[i];
     }
+    return true;
 }
 
 // Insert a HuffmanNode into the min-heap
@@ -0,0 +1,34 @@
+/**
+ * @file logger.cpp
+ * @brief Implementation of the log level switch.
+ */
+#include "logger.h"
+#include <atomic>
+#include <iostream>
+
+using namespace std;
+
+namespace logger {
+    namespace {
+        atomic<LogLevel> currentLevel{LogLevel::Quiet};
+
+        // Stream with no buffer; every write fails silently
+        ostream discard(nullptr);
+    }
+
+    void setLevel(LogLevel level) {
+        currentLevel.store(level, memory_order_relaxed);
+    }
+
+    LogLevel level() {
+        return currentLevel.load(memory_order_relaxed);
+    }
+
+    bool enabled(LogLevel messageLevel) {
+        return messageLevel != LogLevel::Quiet && messageLevel <= level();
+    }
+
+    ostream& log(LogLevel messageLevel) {
+        return enabled(messageLevel) ? cerr : discard;
+    }
+}
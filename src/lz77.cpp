@@ -0,0 +1,133 @@
+/**
+ * @file lz77.cpp
+ * @brief Hash-chain LZ77 parsing.
+ */
+#include "lz77.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+    // Chain depth, length at which the search stops early, and whether to look one byte ahead for a longer match
+    struct LevelSettings {
+        unsigned depth;
+        uint32_t nice;
+        bool lazy;
+    };
+
+    const LevelSettings LEVELS[LZ_MAX_LEVEL + 1] = {
+        {0, 0, false},       // Unused: level 0 means no LZ77 stage
+        {4, 16, false},
+        {8, 24, false},
+        {16, 32, false},
+        {16, 32, true},
+        {32, 64, true},
+        {64, 128, true},
+        {128, 256, true},
+        {256, 512, true},
+        {1024, 1024, true},
+    };
+
+    // Once a match is this long, the lazy search one byte later follows a quarter of the chain
+    const uint32_t GOOD_LENGTH = 32;
+
+    // After every 2^SKIP_SHIFT bytes without a match, the search steps one byte further; incompressible
+    // data is then passed over quickly instead of searched at every position
+    const unsigned SKIP_SHIFT = 7;
+
+    uint32_t load32(const unsigned char* ptr) {
+        uint32_t value;
+        memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+
+    // Number of equal bytes at a and b, at most limit; compares eight bytes at a time
+    uint32_t matchLength(const unsigned char* a, const unsigned char* b, uint32_t limit) {
+        uint32_t length = 0;
+        while (length + 8 <= limit) {
+            uint64_t x, y;
+            memcpy(&x, a + length, 8);
+            memcpy(&y, b + length, 8);
+            if (x != y) {
+                return length + static_cast<uint32_t>(__builtin_ctzll(x ^ y) >> 3); // Little-endian: lowest differing byte
+            }
+            length += 8;
+        }
+        while (length < limit && a[length] == b[length]) {
+            ++length;
+        }
+        return length;
+    }
+}
+
+void LzMatchFinder::insert(const unsigned char* data, size_t pos) {
+    uint32_t hash = (load32(data + pos) * 2654435761u) >> (32 - HASH_BITS);
+    chain[pos & (LZ_WINDOW_SIZE - 1)] = head[hash];
+    head[hash] = static_cast<uint32_t>(pos + 1);
+}
+
+uint32_t LzMatchFinder::findMatch(const unsigned char* data, size_t size, size_t pos, unsigned depth, uint32_t nice, uint32_t& distance) const {
+    uint32_t hash = (load32(data + pos) * 2654435761u) >> (32 - HASH_BITS);
+    uint32_t limit = static_cast<uint32_t>(min<size_t>(size - pos, UINT32_MAX));
+    uint32_t best = 0;
+    for (uint32_t candidate = head[hash]; candidate != 0 && depth-- > 0; candidate = chain[(candidate - 1) & (LZ_WINDOW_SIZE - 1)]) {
+        size_t from = candidate - 1;
+        if (pos - from > LZ_WINDOW_SIZE - 1) {
+            break; // Older positions have left the window and their chain slots were reused
+        }
+        if (data[from + best] != data[pos + best]) {
+            continue; // Cannot beat the best match so far
+        }
+        uint32_t length = matchLength(data + from, data + pos, limit);
+        if (length > best) {
+            best = length;
+            distance = static_cast<uint32_t>(pos - from);
+            if (best >= nice || best == limit) {
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+// Greedy parse with optional one-step lazy matching: a match is deferred when the next byte starts a longer one
+void LzMatchFinder::parse(const unsigned char* data, size_t size, unsigned level, vector<LzSequence>& sequences, vector<unsigned char>& literals) {
+    const LevelSettings& settings = LEVELS[min(max(level, 1u), LZ_MAX_LEVEL)];
+    sequences.clear();
+    literals.clear();
+    head.assign(size_t(1) << HASH_BITS, 0);
+    chain.resize(min<size_t>(size, LZ_WINDOW_SIZE));
+
+    size_t anchor = 0; // First byte not yet covered by a sequence
+    size_t pos = 0;
+    while (pos + LZ_MIN_MATCH <= size) {
+        uint32_t distance = 0;
+        uint32_t length = findMatch(data, size, pos, settings.depth, settings.nice, distance);
+        insert(data, pos);
+        if (length < LZ_MIN_MATCH) {
+            pos += 1 + ((pos - anchor) >> SKIP_SHIFT);
+            continue;
+        }
+        while (settings.lazy && length < settings.nice && pos + 1 + LZ_MIN_MATCH <= size) {
+            uint32_t nextDistance = 0;
+            unsigned depth = length >= GOOD_LENGTH ? max(settings.depth >> 2, 1u) : settings.depth;
+            uint32_t nextLength = findMatch(data, size, pos + 1, depth, settings.nice, nextDistance);
+            if (nextLength <= length) {
+                break;
+            }
+            insert(data, ++pos); // The byte at pos becomes a literal
+            length = nextLength;
+            distance = nextDistance;
+        }
+
+        sequences.push_back({static_cast<uint32_t>(pos - anchor), length, distance});
+        literals.insert(literals.end(), data + anchor, data + pos);
+        size_t end = pos + length;
+        for (++pos; pos < end && pos + LZ_MIN_MATCH <= size; ++pos) {
+            insert(data, pos);
+        }
+        pos = end;
+        anchor = end;
+    }
+    literals.insert(literals.end(), data + anchor, data + size);
+}
@@ -1,84 +1,323 @@
 #include "compressor.h"
+#include "archive.h"
+#include "cpuFeatures.h"
+#include "dictionary.h"
 #include "huffman.h"
 #include "fileHandles.h"
+#include "logger.h"
+#include "lz77.h"
+#include "stats.h"
+#include "threadPool.h"
 
 #include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 using namespace std;
 using namespace compressor;
 using namespace fileHandles;
+using logger::LogLevel;
 namespace fs = std::filesystem;
 
+// Parses a byte count with an optional K or M suffix; signs and spaces, which stoull would skip or wrap, are rejected
+bool parseSize(const string& text, uint64_t& value) {
+    if (text.empty() || !isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+    size_t end = 0;
+    try {
+        value = stoull(text, &end);
+    } catch (const exception&) {
+        return false;
+    }
+    string suffix = text.substr(end);
+    unsigned shift = 0;
+    if (suffix == "K" || suffix == "k") {
+        shift = 10;
+    } else if (suffix == "M" || suffix == "m") {
+        shift = 20;
+    } else if (!suffix.empty()) {
+        return false;
+    }
+    if (value > (UINT64_MAX >> shift)) {
+        return false;
+    }
+    value <<= shift;
+    return true;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        cout << "Usage: " << argv[0] << " <compress|decompress> <input_file_path> <output_file_path>" << endl;
+    vector<string> args;                       // Positional arguments
+    CompressOptions compressOptions;           // Settings used for compression
+    DecompressOptions decompressOptions;       // Settings used for decompression and extraction
+    uint64_t extractOffset = 0;                // First byte extracted
+    uint64_t extractLength = UINT64_MAX;       // Number of bytes extracted
+    bool printStatistics = false;              // Report timings and sizes after the run
+    bool statisticsAsJson = false;             // Report them as one JSON object
+    string dictionaryPath;                     // Trained codes shared by compression and decompression
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--decoder=tree") {
+            decompressOptions.decoder = DecoderType::Tree;
+        } else if (arg == "--decoder=table") {
+            decompressOptions.decoder = DecoderType::Table;
+        } else if (arg.rfind("--block-size=", 0) == 0) {
+            uint64_t blockSize = 0;
+            if (!parseSize(arg.substr(13), blockSize) || blockSize < MIN_BLOCK_SIZE || blockSize > MAX_BLOCK_SIZE) {
+                cerr << "Block size must be between " << MIN_BLOCK_SIZE << " and " << MAX_BLOCK_SIZE << " bytes." << endl;
+                return 1;
+            }
+            compressOptions.blockSize = static_cast<size_t>(blockSize);
+        } else if (arg.rfind("--max-code-length=", 0) == 0) {
+            string value = arg.substr(18);
+            if (value.empty() || value.find_first_not_of("0123456789") != string::npos || value.size() > 3
+                || stoul(value) < MIN_CODE_LENGTH_LIMIT || stoul(value) > MAX_CODE_LENGTH_LIMIT) {
+                cerr << "Maximum code length must be between " << MIN_CODE_LENGTH_LIMIT << " and " << MAX_CODE_LENGTH_LIMIT << " bits." << endl;
+                return 1;
+            }
+            compressOptions.maxCodeLength = static_cast<unsigned>(stoul(value));
+        } else if (arg == "-T" && i + 1 < argc) {
+            string value = argv[++i];
+            uint64_t threads = 0;
+            if (value.empty() || value.find_first_not_of("0123456789") != string::npos || !parseSize(value, threads)
+                || threads > ThreadPool::MAX_THREADS) {
+                cerr << "Thread count must be between 0 and " << ThreadPool::MAX_THREADS << "." << endl;
+                return 1;
+            }
+            compressOptions.threads = static_cast<unsigned>(threads);
+            decompressOptions.threads = compressOptions.threads;
+        } else if ((arg == "--offset" || arg == "--length") && i + 1 < argc) {
+            uint64_t& target = arg == "--offset" ? extractOffset : extractLength;
+            if (!parseSize(argv[++i], target)) {
+                cerr << "Invalid value for " << arg << ": " << argv[i] << endl;
+                return 1;
+            }
+        } else if (arg.rfind("--level=", 0) == 0) {
+            string value = arg.substr(8);
+            if (value.size() != 1 || !isdigit(static_cast<unsigned char>(value[0]))) {
+                cerr << "Level must be between 0 and " << LZ_MAX_LEVEL << "." << endl;
+                return 1;
+            }
+            compressOptions.level = static_cast<unsigned>(value[0] - '0');
+        } else if (arg == "--streams=1" || arg == "--streams=4") {
+            compressOptions.streams = arg == "--streams=4" ? 4 : 1;
+        } else if (arg == "--checksum") {
+            compressOptions.checksum = true;
+        } else if (arg == "--codec=huffman") {
+            compressOptions.codec = Codec::Huffman;
+        } else if (arg == "--codec=ans") {
+            compressOptions.codec = Codec::Ans;
+        } else if (arg.rfind("--dict=", 0) == 0 && arg.size() > 7) {
+            dictionaryPath = arg.substr(7);
+        } else if (arg == "--stats" || arg == "--stats=text" || arg == "--stats=json") {
+            printStatistics = true;
+            statisticsAsJson = arg == "--stats=json";
+        } else if (arg.rfind("--cpu=", 0) == 0) {
+            CpuLevel level = CpuLevel::Scalar;
+            if (!parseCpuLevel(arg.substr(6), level)) {
+                cerr << "Invalid value for --cpu: " << arg.substr(6) << endl;
+                return 1;
+            }
+            if (!setCpuLevel(level)) {
+                cerr << "This processor does not support " << cpuLevelName(level) << "; the newest it supports is "
+                     << cpuLevelName(detectedCpuLevel()) << "." << endl;
+                return 1;
+            }
+        } else if (arg == "--log-level=quiet") {
+            logger::setLevel(LogLevel::Quiet);
+        } else if (arg == "--log-level=info" || arg == "-v") {
+            logger::setLevel(LogLevel::Info);
+        } else if (arg == "--log-level=debug") {
+            logger::setLevel(LogLevel::Debug);
+        } else if (arg.rfind("--", 0) == 0 || arg.rfind("-T", 0) == 0) {
+            cerr << "Unknown option: " << arg << endl;
+            return 1;
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.size() != (!args.empty() && args[0] == "verify" ? 2u : 3u)) {
+        cerr << "Usage: " << argv[0] << " <compress|decompress|extract> <input_file_path> <output_file_path> [options]" << endl
+             << "       " << argv[0] << " archive <input_directory> <archive_file> [options]" << endl
+             << "       " << argv[0] << " extract-archive <archive_file> <output_directory> [options]" << endl
+             << "       " << argv[0] << " train <sample_file_or_directory> <dictionary_file> [options]" << endl
+             << "       " << argv[0] << " verify <compressed_file_or_archive> [options]" << endl
+             << "  --decoder=tree|table   decoder used by decompress and extract" << endl
+             << "  --block-size=N[K|M]    uncompressed bytes per block" << endl
+             << "  --max-code-length=N    longest Huffman code in bits (" << MIN_CODE_LENGTH_LIMIT << "-" << MAX_CODE_LENGTH_LIMIT << ")" << endl
+             << "  --level=N              LZ77 match search effort, 1 (fast) to " << LZ_MAX_LEVEL << " (small); 0 = off (default)" << endl
+             << "  --streams=1|4          bit streams per Huffman payload; 4 decodes faster (default 1)" << endl
+             << "  --codec=huffman|ans    entropy coder kept when both cost the same (default huffman)" << endl
+             << "  --checksum             store a CRC-32C of each block, checked when it is decoded" << endl
+             << "  -T threads             worker threads (0 = all hardware threads, at most " << ThreadPool::MAX_THREADS << ")" << endl
+             << "  --offset X --length N  byte range written by extract" << endl
+             << "  --dict=file            code with or decode using a dictionary made by train" << endl
+             << "  --stats[=text|json]    print stage timings, sizes and peak memory to stderr (not for archives or train)" << endl
+             << "  --cpu=scalar|sse4.2|avx2" << endl
+             << "                         instruction set for the hot loops (default: newest supported)" << endl
+             << "  --log-level=quiet|info|debug, -v" << endl
+             << "                         progress messages on stderr (default quiet)" << endl
+             << "A file path of - reads standard input or writes standard output (compress, decompress, verify)." << endl;
         return 1;
     }
 
-    string mode = argv[1];
-    string inputPath = argv[2];
-    string outputPath = argv[3];
+    string mode = args[0];
+    string inputPath = args[1];
+    string outputPath = args.size() > 2 ? args[2] : string();
     fs::path filePath_in(inputPath);
     fs::path filePath_out(outputPath);
 
+    if (!dictionaryPath.empty()) {
+        shared_ptr<Dictionary> dictionary = make_shared<Dictionary>();
+        if (!loadDictionary(dictionaryPath, *dictionary)) {
+            return 1;
+        }
+        compressOptions.dictionary = dictionary;
+        decompressOptions.dictionary = dictionary;
+    }
+
+    if (printStatistics && (mode == "archive" || mode == "extract-archive" || mode == "train")) {
+        cerr << "--stats is not supported by " << mode << "." << endl;
+        return 1;
+    }
+
+    RunStats stats;                            // Filled in by the operation when statistics are requested
+    RunStats* statsTarget = printStatistics ? &stats : nullptr;
+
     // Display the current working directory
-    cout << "Current Working Directory: " << fs::current_path() << endl;
-    cout << "|WELCOME TO THE FILE COMPRESSOR|" << endl
-         << "________________________________" << endl;
-    cout << "This program uses Huffman coding to compress and decompress files." << endl;
+    logger::log(LogLevel::Info) << "Current Working Directory: " << fs::current_path() << endl;
+    logger::log(LogLevel::Info) << "Instruction set: " << cpuLevelName(cpuLevel()) << endl;
+    logger::log(LogLevel::Debug) << "|WELCOME TO THE FILE COMPRESSOR|" << endl
+                                 << "________________________________" << endl
+                                 << "This program uses Huffman coding to compress and decompress files." << endl;
 
     if (mode == "compress") {
         if (!fileExists(filePath_in)) {
-            cout << "File does not exist: " << filePath_in << endl;
+            cerr << "File does not exist: " << filePath_in << endl;
             return 1;
         }
 
-        // Copy the input file to the current directory as "infile.txt"
-        fs::copy_file(filePath_in, fs::current_path() / "infile.txt");
-
-        cout << "Reading file from: " << filePath_in << endl;
-        readFileHUF("infile.txt"); // Read the file to build the frequency map
+        logger::log(LogLevel::Info) << "Reading file from: " << filePath_in << endl;
 
         if (!fileExists(filePath_out)) {
             ofstream outfile(filePath_out.string());
             if (!outfile) {
-                cout << "Failed to create file: " << filePath_out << endl;
+                cerr << "Failed to create file: " << filePath_out << endl;
                 return 1;
             }
             outfile.close();
         }
 
-        compress("infile.txt", filePath_out.string()); // Compress the file
-        cout << "File successfully compressed to " << filePath_out << endl;
+        if (!compress(filePath_in.string(), filePath_out.string(), compressOptions, statsTarget)) { // Compress the file
+            return 1;
+        }
+        logger::log(LogLevel::Info) << "File successfully compressed to " << filePath_out << endl;
 
     } else if (mode == "decompress") {
         if (!fileExists(filePath_in)) {
-            cout << "File does not exist: " << filePath_in << endl;
+            cerr << "File does not exist: " << filePath_in << endl;
             return 1;
         }
 
-        // Copy the input compressed file to the current directory as "infile.bin"
-        fs::copy_file(filePath_in, fs::current_path() / "infile.bin");
-
         if (!fileExists(filePath_out)) {
             ofstream outfile(filePath_out.string());
             if (!outfile) {
-                cout << "Failed to create file: " << filePath_out << endl;
+                cerr << "Failed to create file: " << filePath_out << endl;
                 return 1;
             }
             outfile.close();
         }
 
-        decompress("infile.bin", filePath_out.string()); // Decompress the file
-        cout << "File successfully decompressed to " << filePath_out << endl;
+        if (!decompress(filePath_in.string(), filePath_out.string(), decompressOptions, statsTarget)) { // Decompress the file
+            return 1;
+        }
+        logger::log(LogLevel::Info) << "File successfully decompressed to " << filePath_out << endl;
+
+    } else if (mode == "extract") {
+        if (!fileExists(filePath_in)) {
+            cerr << "File does not exist: " << filePath_in << endl;
+            return 1;
+        }
+
+        // Only the blocks covering the range are read and decoded
+        if (!extract(filePath_in.string(), filePath_out.string(), extractOffset, extractLength, decompressOptions, statsTarget)) {
+            return 1;
+        }
+        logger::log(LogLevel::Info) << "Bytes " << extractOffset << " onwards successfully extracted to " << filePath_out << endl;
+
+    } else if (mode == "archive") {
+        if (!fs::is_directory(filePath_in)) {
+            cerr << "Not a directory: " << filePath_in << endl;
+            return 1;
+        }
+
+        // Every file below the directory goes into one archive
+        if (!archive(filePath_in.string(), filePath_out.string(), compressOptions)) {
+            return 1;
+        }
+        logger::log(LogLevel::Info) << "Directory successfully archived to " << filePath_out << endl;
+
+    } else if (mode == "extract-archive") {
+        if (!fileExists(filePath_in)) {
+            cerr << "File does not exist: " << filePath_in << endl;
+            return 1;
+        }
+
+        if (!extractArchive(filePath_in.string(), filePath_out.string(), decompressOptions)) {
+            return 1;
+        }
+        logger::log(LogLevel::Info) << "Archive successfully extracted to " << filePath_out << endl;
+
+    } else if (mode == "train") {
+        if (!fs::exists(filePath_in)) {
+            cerr << "File does not exist: " << filePath_in << endl;
+            return 1;
+        }
+
+        // Codes are built from all samples together and saved for --dict
+        if (!trainDictionary(filePath_in.string(), filePath_out.string(), compressOptions.maxCodeLength)) {
+            return 1;
+        }
+        logger::log(LogLevel::Info) << "Dictionary successfully written to " << filePath_out << endl;
+
+    } else if (mode == "verify") {
+        if (!fileExists(filePath_in)) {
+            cerr << "File does not exist: " << filePath_in << endl;
+            return 1;
+        }
+
+        // Archives and single compressed files have different magics; either is decoded in full and discarded
+        // (a piped archive cannot be probed without consuming it, so standard input is taken as a single file)
+        char magic[sizeof(ARCHIVE_MAGIC)] = {};
+        if (filePath_in != STANDARD_STREAM) {
+            ifstream probe(filePath_in, ios::binary);
+            probe.read(magic, sizeof(magic));
+        }
+        bool isArchive = equal(magic, magic + sizeof(magic), ARCHIVE_MAGIC);
+        if (isArchive && printStatistics) {
+            cerr << "--stats is not supported when verifying an archive." << endl;
+            return 1;
+        }
+        if (isArchive ? !verifyArchive(filePath_in.string(), decompressOptions)
+                      : !verify(filePath_in.string(), decompressOptions, statsTarget)) {
+            return 1;
+        }
+        logger::log(LogLevel::Info) << filePath_in << " is intact" << endl;
 
     } else {
-        cout << "Invalid mode. Use 'compress' or 'decompress'." << endl;
+        cerr << "Invalid mode. Use 'compress', 'decompress', 'extract', 'archive', 'extract-archive', 'train' or 'verify'." << endl;
         return 1;
     }
 
+    if (printStatistics && !stats.operation.empty()) {
+        printStats(stats, statisticsAsJson, cerr);
+    }
     return 0;
 }
\ No newline at end of file
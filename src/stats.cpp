@@ -0,0 +1,151 @@
+/**
+ * @file stats.cpp
+ * @brief Stage timers and the --stats report.
+ */
+#include "stats.h"
+#include <cstdio>
+#include <ctime>
+
+#include <sys/resource.h>
+
+using namespace std;
+
+namespace compressor {
+    namespace {
+        const char* const STAGE_NAMES[] = {"read", "histogram", "build", "encode", "decode", "write"};
+        static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == static_cast<size_t>(Stage::Count), "one name per stage");
+
+        double seconds(const timeval& time) {
+            return time.tv_sec + time.tv_usec / 1e6;
+        }
+
+        // Prints the stages that took time as "name":{...} members or table rows
+        void printStages(const StageTimes& times, bool json, ostream& out) {
+            char line[128];
+            bool first = true;
+            for (size_t stage = 0; stage < times.size(); ++stage) {
+                if (times[stage].wallSeconds <= 0 && times[stage].cpuSeconds <= 0) {
+                    continue;
+                }
+                if (json) {
+                    snprintf(line, sizeof(line), "%s\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f}", first ? "" : ",", STAGE_NAMES[stage],
+                             times[stage].wallSeconds * 1e3, times[stage].cpuSeconds * 1e3);
+                } else {
+                    snprintf(line, sizeof(line), "  %-10s %12.3f %12.3f\n", STAGE_NAMES[stage], times[stage].wallSeconds * 1e3,
+                             times[stage].cpuSeconds * 1e3);
+                }
+                out << line;
+                first = false;
+            }
+        }
+    }
+
+    const char* stageName(Stage stage) {
+        return STAGE_NAMES[static_cast<size_t>(stage)];
+    }
+
+    StageTimer::StageTimer() : wallStart(chrono::steady_clock::now()), cpuStart(threadCpuSeconds()) {}
+
+    void StageTimer::stop(StageTimes& times, Stage stage) {
+        chrono::steady_clock::time_point wallNow = chrono::steady_clock::now();
+        double cpuNow = threadCpuSeconds();
+        StageTime& time = times[static_cast<size_t>(stage)];
+        time.wallSeconds += chrono::duration<double>(wallNow - wallStart).count();
+        time.cpuSeconds += cpuNow - cpuStart;
+        wallStart = wallNow;
+        cpuStart = cpuNow;
+    }
+
+    double threadCpuSeconds() {
+        timespec time;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) {
+            return 0;
+        }
+        return time.tv_sec + time.tv_nsec / 1e9;
+    }
+
+    double processCpuSeconds() {
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+        return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+    }
+
+    uint64_t peakResidentBytes() {
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+#ifdef __APPLE__
+        return static_cast<uint64_t>(usage.ru_maxrss);        // Reported in bytes
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024; // Reported in kilobytes
+#endif
+    }
+
+    void addStageTimes(StageTimes& total, const StageTimes& times) {
+        for (size_t stage = 0; stage < total.size(); ++stage) {
+            total[stage].wallSeconds += times[stage].wallSeconds;
+            total[stage].cpuSeconds += times[stage].cpuSeconds;
+        }
+    }
+
+    void printStats(const RunStats& stats, bool json, ostream& out) {
+        char line[256];
+        if (json) {
+            snprintf(line, sizeof(line),
+                     "{\"operation\":\"%s\",\"bytes_in\":%llu,\"bytes_out\":%llu,\"ratio\":%.4f,\"wall_ms\":%.3f,\"cpu_ms\":%.3f,"
+                     "\"peak_rss_bytes\":%llu,\"stages\":{",
+                     stats.operation.c_str(), static_cast<unsigned long long>(stats.bytesIn), static_cast<unsigned long long>(stats.bytesOut),
+                     stats.ratio, stats.wallSeconds * 1e3, stats.cpuSeconds * 1e3, static_cast<unsigned long long>(stats.peakResidentBytes));
+            out << line;
+            printStages(stats.stages, true, out);
+            out << "},\"blocks\":[";
+            for (size_t i = 0; i < stats.blocks.size(); ++i) {
+                const BlockStats& block = stats.blocks[i];
+                snprintf(line, sizeof(line), "%s{\"original\":%llu,\"compressed\":%llu,", i ? "," : "",
+                         static_cast<unsigned long long>(block.originalSize), static_cast<unsigned long long>(block.compressedSize));
+                out << line;
+                if (block.payloadBits > 0) { // Only known when compressing
+                    out << "\"payload_bits\":" << block.payloadBits << ",";
+                }
+                if (*block.mode) {
+                    out << "\"mode\":\"" << block.mode << "\",";
+                }
+                out << "\"stages\":{";
+                printStages(block.times, true, out);
+                out << "}}";
+            }
+            out << "]}" << endl;
+            return;
+        }
+
+        snprintf(line, sizeof(line), "%s: %llu bytes in, %llu bytes out, ratio %.4f\n", stats.operation.c_str(),
+                 static_cast<unsigned long long>(stats.bytesIn), static_cast<unsigned long long>(stats.bytesOut), stats.ratio);
+        out << line;
+        snprintf(line, sizeof(line), "  %-10s %12s %12s\n", "stage", "wall ms", "cpu ms");
+        out << line;
+        printStages(stats.stages, false, out);
+        snprintf(line, sizeof(line), "  %-10s %12.3f %12.3f\n", "total", stats.wallSeconds * 1e3, stats.cpuSeconds * 1e3);
+        out << line;
+        snprintf(line, sizeof(line), "  peak RSS %.1f MiB\n", stats.peakResidentBytes / 1048576.0);
+        out << line;
+        if (!stats.blocks.empty()) {
+            snprintf(line, sizeof(line), "  %-6s %12s %12s %8s %12s %-10s\n", "block", "original", "compressed", "ratio", "wall ms", "mode");
+            out << line;
+        }
+        for (size_t i = 0; i < stats.blocks.size(); ++i) {
+            const BlockStats& block = stats.blocks[i];
+            double wall = 0;
+            for (const StageTime& time : block.times) {
+                wall += time.wallSeconds;
+            }
+            snprintf(line, sizeof(line), "  %-6zu %12llu %12llu %8.4f %12.3f %-10s\n", i, static_cast<unsigned long long>(block.originalSize),
+                     static_cast<unsigned long long>(block.compressedSize),
+                     block.compressedSize ? static_cast<double>(block.originalSize) / block.compressedSize : 0.0, wall * 1e3, block.mode);
+            out << line;
+        }
+        out << flush;
+    }
+}
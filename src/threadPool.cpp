@@ -0,0 +1,55 @@
+/**
+ * @file threadPool.cpp
+ * @brief Implementation of the ThreadPool class.
+ */
+#include "threadPool.h"
+#include <algorithm>
+
+// Start the workers; each one waits for tasks on the shared queue
+ThreadPool::ThreadPool(unsigned threads) {
+    threads = std::max(threads, 1u);
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+// Let the workers drain the queue, then join them
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned ThreadPool::size() const {
+    return static_cast<unsigned>(workers.size());
+}
+
+// Map 0 to the number of hardware threads and keep the count where thread creation cannot fail for its size alone
+unsigned ThreadPool::resolveThreadCount(unsigned requested) {
+    if (requested == 0) {
+        requested = std::thread::hardware_concurrency();
+    }
+    return std::min(std::max(requested, 1u), MAX_THREADS);
+}
+
+// Run tasks until the pool stops and the queue is empty
+void ThreadPool::workerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return; // Stopping and nothing left to run
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,95 @@
+/**
+ * @file workStealingPool.cpp
+ * @brief Implementation of the WorkStealingPool class.
+ */
+#include "workStealingPool.h"
+#include <algorithm>
+
+namespace {
+    // The pool and queue index of the calling thread, if it is a worker
+    thread_local const WorkStealingPool* currentPool = nullptr;
+    thread_local unsigned currentQueue = 0;
+}
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+    threads = std::max(threads, 1u);
+    for (unsigned i = 0; i < threads; ++i) {
+        queues.emplace_back(new TaskQueue());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+// Let the workers drain every queue, then join them
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned WorkStealingPool::size() const {
+    return static_cast<unsigned>(workers.size());
+}
+
+// Workers keep their own tasks; other threads spread theirs round robin
+void WorkStealingPool::enqueue(std::function<void()> task) {
+    unsigned target = currentPool == this ? currentQueue : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    queued.fetch_add(1); // Counted first so it never drops below zero when the task is stolen at once
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mutex);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex); // Pairs with the check in workerLoop so the wakeup is not lost
+    }
+    available.notify_one();
+}
+
+// Pops the newest task of the worker's own queue, or steals the oldest task of another
+bool WorkStealingPool::takeTask(unsigned self, std::function<void()>& task) {
+    {
+        TaskQueue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        TaskQueue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Run tasks until the pool stops and every queue is empty
+void WorkStealingPool::workerLoop(unsigned self) {
+    currentPool = this;
+    currentQueue = self;
+    for (;;) {
+        std::function<void()> task;
+        if (takeTask(self, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        available.wait(lock, [this]() { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0) {
+            return; // Stopping and nothing left to run
+        }
+    }
+}